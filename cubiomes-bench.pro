@@ -0,0 +1,13 @@
+#-------------------------------------------------
+#
+# Headless benchmarks, built from the viewer sources:
+#  $ qmake ../cubiomes-bench.pro && make
+#
+#-------------------------------------------------
+
+include(cubiomes-viewer.pro)
+
+TARGET = cubiomes-bench
+
+SOURCES -= src/main.cpp
+SOURCES += src/bench.cpp
@@ -34,6 +34,7 @@ CONFIG += static
 
 SOURCES += \
         src/aboutdialog.cpp \
+        src/analysis.cpp \
         src/collapsible.cpp \
         src/configdialog.cpp \
         src/extgendialog.cpp \
@@ -44,12 +45,18 @@ SOURCES += \
         src/protobasedialog.cpp \
         src/filterdialog.cpp \
         src/quadlistdialog.cpp \
+        src/mapexport.cpp \
+        src/mapexportdialog.cpp \
+        src/maptrace.cpp \
         src/mapview.cpp \
         src/quad.cpp \
         src/rangedialog.cpp \
         src/search.cpp \
         src/searchitem.cpp \
         src/searchthread.cpp \
+        src/seedpreviewdialog.cpp \
+        src/tilecache.cpp \
+        src/tilescheduler.cpp \
         src/mainwindow.cpp \
         src/main.cpp
 
@@ -59,6 +66,7 @@ HEADERS += \
         $$CUPATH/layers.h \
         $$CUPATH/util.h \
         src/aboutdialog.h \
+        src/analysis.h \
         src/collapsible.h \
         src/configdialog.h \
         src/extgendialog.h \
@@ -69,6 +77,9 @@ HEADERS += \
         src/protobasedialog.h \
         src/filterdialog.h \
         src/quadlistdialog.h \
+        src/mapexport.h \
+        src/mapexportdialog.h \
+        src/maptrace.h \
         src/mapview.h \
         src/quad.h \
         src/cutil.h \
@@ -76,6 +87,9 @@ HEADERS += \
         src/search.h \
         src/searchitem.h \
         src/searchthread.h \
+        src/seedpreviewdialog.h \
+        src/tilecache.h \
+        src/tilescheduler.h \
         src/seedtables.h \
         src/mainwindow.h \
         src/settings.h
@@ -91,8 +105,10 @@ FORMS += \
         src/protobasedialog.ui \
         src/filterdialog.ui \
         src/quadlistdialog.ui\
+        src/mapexportdialog.ui \
         src/mainwindow.ui \
-        src/rangedialog.ui
+        src/rangedialog.ui \
+        src/seedpreviewdialog.ui
 
 RESOURCES += \
         icons.qrc \
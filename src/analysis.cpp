@@ -0,0 +1,622 @@
+#include "analysis.h"
+#include "tilecache.h"
+
+#include <QtEndian>
+
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <random>
+
+
+// section size of the area in blocks for structures, biomes are processed in
+// sections that are aligned to the biome tiles of the map
+#define STRUCT_TILE 16384
+// condition origins per section side
+#define COND_TILE   32
+// maximum number of reported condition locations
+#define COND_LIMIT  65536
+
+enum { TASK_BIOMES, TASK_STRUCTS, TASK_SPAWN, TASK_STRONGHOLDS, TASK_CONDS };
+
+struct AnalysisTask
+{
+    int type;
+    int opt;                // dimension (biomes) or map option (structures)
+    int x0, z0, x1, z1;     // section of the area (inclusive)
+};
+
+static inline int floordiv(int a, int b)
+{
+    return a >= 0 ? a / b : -1 - (-1 - a) / b;
+}
+
+static void addTiles(std::vector<AnalysisTask>& tasks, int type, int opt,
+        int x1, int z1, int x2, int z2, int step)
+{
+    for (int64_t x = x1; x <= x2; x += step)
+    {
+        for (int64_t z = z1; z <= z2; z += step)
+        {
+            AnalysisTask t;
+            t.type = type;
+            t.opt = opt;
+            t.x0 = (int) x;
+            t.z0 = (int) z;
+            t.x1 = (int) std::min<int64_t>(x + step - 1, x2);
+            t.z1 = (int) std::min<int64_t>(z + step - 1, z2);
+            tasks.push_back(t);
+        }
+    }
+}
+
+// sections on a grid of tiles with a width of tb blocks
+static void addGridTiles(std::vector<AnalysisTask>& tasks, int type, int opt,
+        int x1, int z1, int x2, int z2, int tb)
+{
+    for (int64_t tx = floordiv(x1, tb); tx * tb <= x2; tx++)
+    {
+        for (int64_t tz = floordiv(z1, tb); tz * tb <= z2; tz++)
+        {
+            AnalysisTask t;
+            t.type = type;
+            t.opt = opt;
+            t.x0 = (int) std::max<int64_t>(tx * tb, x1);
+            t.z0 = (int) std::max<int64_t>(tz * tb, z1);
+            t.x1 = (int) std::min<int64_t>(tx * tb + tb - 1, x2);
+            t.z1 = (int) std::min<int64_t>(tz * tb + tb - 1, z2);
+            tasks.push_back(t);
+        }
+    }
+}
+
+
+struct AnalysisWorker : public QRunnable
+{
+    AnalysisThread *at;
+    Generator g[3];
+    bool seeded[3];
+    SurfaceNoise sne;
+    bool initsne;
+    WorldGen wgen;
+    BiomeMemo memo;
+    bool initwgen;
+    QVector<Condition> condvec;
+
+    AnalysisWorker(AnalysisThread *at)
+        : at(at),g(),seeded(),sne(),initsne(),wgen(),memo(),initwgen()
+        , condvec(at->ac.condvec)
+    {
+    }
+
+    // generators are seeded once per dimension for the lifetime of the worker
+    Generator *gen(int dim)
+    {
+        Generator *p = &g[dim+1];
+        if (!seeded[dim+1])
+        {
+            setupGenerator(p, at->ac.wi.mc, at->ac.wi.large);
+            applySeed(p, dim, at->ac.wi.seed);
+            seeded[dim+1] = true;
+        }
+        return p;
+    }
+
+    void run()
+    {
+        int i;
+        while (!at->abort && (i = at->next++) < (int)at->tasks.size())
+        {
+            process(at->tasks[i]);
+            at->done++;
+        }
+    }
+
+    void process(const AnalysisTask& t);
+    bool countBiomes(const AnalysisTask& t, qint64 *cnt, bool cachedonly);
+    void report(int sopt, const QVector<StructLoc>& locs);
+    void sampleBiomes(const AnalysisTask& t);
+};
+
+/* Reports the structures of a section, either to the UI or, when streaming,
+ * to the export file with only a capped sample for the UI.
+ */
+void AnalysisWorker::report(int sopt, const QVector<StructLoc>& locs)
+{
+    if (!at->exportfile.isOpen())
+    {
+        emit at->structsFound(sopt, locs);
+        return;
+    }
+
+    QByteArray rows;
+    if (at->exportbin)
+    {
+        rows.resize(locs.size() * 16);
+        uchar *b = (uchar*) rows.data();
+        for (const StructLoc& sl : locs)
+        {
+            qToLittleEndian<qint32>(sopt, b);
+            qToLittleEndian<qint32>(sl.p.x, b + 4);
+            qToLittleEndian<qint32>(sl.p.z, b + 8);
+            qToLittleEndian<qint32>(sl.variant, b + 12);
+            b += 16;
+        }
+    }
+    else
+    {
+        const char *name = mapopt2str(sopt);
+        char line[64];
+        for (const StructLoc& sl : locs)
+        {
+            int n = snprintf(line, sizeof(line), "%s,%d,%d,%d\n", name, sl.p.x, sl.p.z, sl.variant);
+            rows.append(line, n);
+        }
+    }
+
+    QVector<StructLoc> sample;
+    qint64 total;
+    {
+        QMutexLocker locker(&at->exportmutex);
+        if (at->exportfile.write(rows) != rows.size())
+            at->exporterr = true;
+        total = (at->scnt[sopt] += locs.size());
+        int room = at->ac.streamSample - at->ssampled[sopt];
+        if (room > 0)
+        {
+            sample = locs.mid(0, room);
+            at->ssampled[sopt] += sample.size();
+        }
+    }
+    emit at->structsStreamed(sopt, total, sample);
+}
+
+/* Counts the biome area of a section at the sampling scale. The sections lie
+ * within one biome tile of the map, which is taken from the tile cache when
+ * available, otherwise only the cells of the section are generated. The
+ * analysis never stores tiles, so that it does not evict those of the map.
+ */
+bool AnalysisWorker::countBiomes(const AnalysisTask& t, qint64 *cnt, bool cachedonly)
+{
+    const WorldInfo& wi = at->ac.wi;
+    int s = at->ac.scale;
+    int y = s > 1 ? wi.y >> 2 : wi.y;
+    int pixs = mapTilePixels(wi.mc);
+
+    int cx0 = floordiv(t.x0, s), cz0 = floordiv(t.z0, s);
+    int cx1 = floordiv(t.x1, s), cz1 = floordiv(t.z1, s);
+    int w = cx1 - cx0 + 1, h = cz1 - cz0 + 1;
+    int ti = floordiv(cx0, pixs), tj = floordiv(cz0, pixs);
+
+    // the map tiles are generated with the ocean variants forced, which
+    // only differs from the generator of the analysis before 1.13
+    bool usecache = wi.mc >= MC_1_13;
+
+    Generator *bg = gen(t.opt);
+    TileKey key = { wi.mc, mapGenFlags(wi), wi.seed, t.opt, y, s, pixs, ti, tj };
+    Range r = {s, ti*pixs, tj*pixs, pixs, pixs, y, 1};
+    int *ids = allocCache(bg, r);
+    if (!usecache || !g_tilecache.load(key, ids, pixs*pixs))
+    {
+        free(ids);
+        if (cachedonly)
+            return false;
+        r.x = cx0;
+        r.z = cz0;
+        r.sx = w;
+        r.sz = h;
+        ids = allocCache(bg, r);
+        if (genBiomes(bg, ids, r))
+        {
+            free(ids);
+            return false;
+        }
+    }
+
+    // weigh the cells by their overlap with the section in blocks
+    for (int j = 0; j < h; j++)
+    {
+        int cz = cz0 + j;
+        int64_t oz = std::min<int64_t>((int64_t)cz*s + s - 1, t.z1) - std::max<int64_t>((int64_t)cz*s, t.z0) + 1;
+        for (int i = 0; i < w; i++)
+        {
+            int cx = cx0 + i;
+            int64_t ox = std::min<int64_t>((int64_t)cx*s + s - 1, t.x1) - std::max<int64_t>((int64_t)cx*s, t.x0) + 1;
+            int id = ids[(int64_t)(cz - r.z) * r.sx + (cx - r.x)];
+            if (id >= 0 && id < 256)
+                cnt[id] += ox * oz;
+        }
+    }
+    free(ids);
+    return true;
+}
+
+/* Stratified estimate of the biome fractions: each section is a stratum that
+ * is weighted by its share of the area. Sections with a cached map tile are
+ * counted in full, the others are sampled at random positions.
+ */
+void AnalysisWorker::sampleBiomes(const AnalysisTask& t)
+{
+    const WorldInfo& wi = at->ac.wi;
+    int s = at->ac.scale;
+    int y = s > 1 ? wi.y >> 2 : wi.y;
+    int64_t w = t.x1 - t.x0 + 1, h = t.z1 - t.z0 + 1;
+    double wt = (w * h) / at->biomearea;
+
+    double p[256] = {0};
+    double pvar[256] = {0};
+    qint64 cnt[256] = {0};
+    if (countBiomes(t, cnt, true))
+    {
+        for (int i = 0; i < 256; i++)
+            p[i] = cnt[i] / (double)(w * h);
+    }
+    else
+    {
+        Generator *bg = gen(t.opt);
+        // deterministic sample positions for a given seed and section
+        std::mt19937_64 rng(wi.seed
+            ^ (uint64_t)(uint32_t)t.x0 * 0x9E3779B97F4A7C15ULL
+            ^ (uint64_t)(uint32_t)t.z0 * 0xC2B2AE3D27D4EB4FULL
+            ^ (uint64_t)(t.opt + 1));
+        int n = 0;
+        for (int i = 0; i < at->ac.samples; i++)
+        {
+            int x = t.x0 + (int)(rng() % (uint64_t)w);
+            int z = t.z0 + (int)(rng() % (uint64_t)h);
+            int id = getBiomeAt(bg, s, floordiv(x, s), y, floordiv(z, s));
+            if (id >= 0 && id < 256)
+            {
+                cnt[id]++;
+                n++;
+            }
+        }
+        if (n == 0)
+            return;
+        for (int i = 0; i < 256; i++)
+        {
+            if (!cnt[i])
+                continue;
+            p[i] = cnt[i] / (double) n;
+            // a single sample gives no variance, so take the upper bound
+            pvar[i] = n > 1 ? p[i] * (1 - p[i]) / (n - 1) : 0.25;
+        }
+    }
+
+    QMutexLocker locker(&at->mutex);
+    for (int i = 0; i < 256; i++)
+    {
+        at->idest[i] += wt * p[i];
+        at->idvar[i] += wt * wt * pvar[i];
+    }
+    at->wsum += wt;
+    at->idchanged = true;
+}
+
+void AnalysisWorker::process(const AnalysisTask& t)
+{
+    const WorldInfo& wi = at->ac.wi;
+    const AnalysisConfig& ac = at->ac;
+
+    if (t.type == TASK_BIOMES)
+    {
+        if (ac.samples > 0)
+        {
+            sampleBiomes(t);
+            return;
+        }
+        qint64 cnt[256] = {0};
+        if (!countBiomes(t, cnt, false))
+            return;
+
+        QMutexLocker locker(&at->mutex);
+        for (int i = 0; i < 256; i++)
+            at->idcnt[i] += cnt[i];
+        at->idchanged = true;
+    }
+    else if (t.type == TASK_STRUCTS)
+    {
+        int stype = mapopt2stype(t.opt);
+        StructureConfig sconf;
+        if (!getStructureConfig_override(stype, wi.mc, &sconf))
+            return;
+        if (!initsne)
+        {
+            initSurfaceNoiseEnd(&sne, wi.seed);
+            initsne = true;
+        }
+        std::vector<VarPos> st;
+        getStructs(&st, sconf, wi, gen(mapopt2dim(t.opt)), &sne, t.x0, t.z0, t.x1+1, t.z1+1);
+        if (st.empty())
+            return;
+
+        QVector<StructLoc> locs;
+        locs.reserve(st.size());
+        for (const VarPos& vp : st)
+        {
+            StructLoc sl = { vp.p, vp.variant };
+            locs.push_back(sl);
+        }
+        report(t.opt, locs);
+    }
+    else if (t.type == TASK_SPAWN)
+    {
+        Pos pos = getSpawn(gen(0));
+        if (pos.x >= ac.x1 && pos.x <= ac.x2 && pos.z >= ac.z1 && pos.z <= ac.z2)
+        {
+            StructLoc sl = { pos, 0 };
+            report(D_SPAWN, QVector<StructLoc>() << sl);
+        }
+    }
+    else if (t.type == TASK_STRONGHOLDS)
+    {
+        StrongholdIter sh;
+        initFirstStronghold(&sh, wi.mc, wi.seed);
+        Generator *sg = gen(0);
+        QVector<StructLoc> locs;
+        while (!at->abort && nextStronghold(&sh, sg) > 0)
+        {
+            Pos pos = sh.pos;
+            if (pos.x >= ac.x1 && pos.x <= ac.x2 && pos.z >= ac.z1 && pos.z <= ac.z2)
+            {
+                StructLoc sl = { pos, 0 };
+                locs.push_back(sl);
+            }
+        }
+        if (!locs.empty())
+            report(D_STRONGHOLD, locs);
+    }
+    else if (t.type == TASK_CONDS)
+    {
+        if (!initwgen)
+        {
+            wgen.init(wi.mc, wi.large);
+            wgen.setSeed(wi.seed);
+            wgen.memo = &memo;
+            initwgen = true;
+        }
+
+        QVector<CondLoc> locs;
+        Pos cpos[100];
+        for (int64_t z = t.z0; z <= t.z1; z += at->cstepz)
+        {
+            for (int64_t x = t.x0; x <= t.x1; x += at->cstepx)
+            {
+                if (at->abort || at->condcnt >= COND_LIMIT)
+                    goto L_conds_end;
+
+                Pos origin = {(int)x, (int)z};
+                if (testSeedAt(origin, cpos, &condvec, PASS_FULL_64, &wgen, &at->abort) != COND_OK)
+                    continue;
+                // the scan covers the origins that can reach into the area,
+                // keep those with the first condition inside
+                Pos p = cpos[condvec[0].save];
+                if (p.x < ac.x1 || p.x > ac.x2 || p.z < ac.z1 || p.z > ac.z2)
+                    continue;
+
+                CondLoc cl;
+                cl.origin = origin;
+                for (const Condition& c : condvec)
+                    cl.cpos.push_back(cpos[c.save]);
+
+                // different origins can resolve to the same layout
+                QByteArray layout((const char*) cl.cpos.constData(), cl.cpos.size() * sizeof(Pos));
+                {
+                    QMutexLocker locker(&at->mutex);
+                    if (at->condseen.contains(layout))
+                        continue;
+                    at->condseen.insert(layout);
+                }
+
+                int n = ++at->condcnt;
+                if (n > COND_LIMIT)
+                    break;
+                locs.push_back(cl);
+                if (n == COND_LIMIT)
+                    emit at->condsLimit(n);
+            }
+        }
+L_conds_end:
+        if (!locs.empty())
+            emit at->condsFound(locs);
+    }
+}
+
+
+AnalysisThread::AnalysisThread(QObject *parent)
+    : QThread(parent)
+    , ac(),tasks()
+    , next(),done(),abort()
+    , mutex(),idcnt(),idest(),idvar(),wsum(),idchanged()
+    , biomearea()
+    , cstepx(1),cstepz(1),condseen()
+    , exportmutex(),exportfile(),exportbin(),exporterr()
+    , scnt(),ssampled()
+    , condcnt()
+{
+}
+
+AnalysisThread::~AnalysisThread()
+{
+    abort = true;
+    wait();
+}
+
+void AnalysisThread::set(const AnalysisConfig& ac)
+{
+    this->ac = ac;
+}
+
+bool AnalysisThread::openExport(QString path)
+{
+    if (exportfile.isOpen())
+        exportfile.close();
+    exportfile.setFileName(path);
+    if (!exportfile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    exportbin = path.endsWith(".bin", Qt::CaseInsensitive);
+    exporterr = false;
+    if (exportbin)
+    {
+        // magic, followed by records of 4 little endian int32:
+        // map option, x, z, variant
+        exportfile.write("CBS1", 4);
+    }
+    else
+    {
+        exportfile.write("type,x,z,variant\n");
+    }
+    return true;
+}
+
+void AnalysisThread::run()
+{
+    abort = false;
+    next = 0;
+    done = 0;
+    condcnt = 0;
+    condseen.clear();
+    memset(scnt, 0, sizeof(scnt));
+    memset(ssampled, 0, sizeof(ssampled));
+    memset(idcnt, 0, sizeof(idcnt));
+    memset(idest, 0, sizeof(idest));
+    memset(idvar, 0, sizeof(idvar));
+    wsum = 0;
+    idchanged = false;
+    biomearea = 0;
+    tasks.clear();
+
+    if (ac.biomes)
+    {
+        if (ac.scale != 1 && ac.scale != 4 && ac.scale != 16 && ac.scale != 64)
+            ac.scale = 1;
+        int tb = mapTilePixels(ac.wi.mc) * ac.scale;
+        int dims[] = {0, -1, +1};
+        for (int d = 0; d < 3; d++)
+        {
+            if (dims[d] == ac.dim || !ac.mapOnly)
+            {
+                addGridTiles(tasks, TASK_BIOMES, dims[d], ac.x1, ac.z1, ac.x2, ac.z2, tb);
+                biomearea += ((double)ac.x2 - ac.x1 + 1) * ((double)ac.z2 - ac.z1 + 1);
+            }
+        }
+    }
+
+    if (ac.structs)
+    {
+        for (int sopt = D_DESERT; sopt < D_SPAWN; sopt++)
+        {
+            if (ac.mapOnly && (!ac.show[sopt] || mapopt2dim(sopt) != ac.dim))
+                continue;
+            addTiles(tasks, TASK_STRUCTS, sopt, ac.x1, ac.z1, ac.x2, ac.z2, STRUCT_TILE);
+        }
+        if ((ac.dim == 0 && ac.show[D_SPAWN]) || !ac.mapOnly)
+        {
+            AnalysisTask t = { TASK_SPAWN, 0, ac.x1, ac.z1, ac.x2, ac.z2 };
+            tasks.push_back(t);
+        }
+        if ((ac.dim == 0 && ac.show[D_STRONGHOLD]) || !ac.mapOnly)
+        {
+            AnalysisTask t = { TASK_STRONGHOLDS, 0, ac.x1, ac.z1, ac.x2, ac.z2 };
+            tasks.push_back(t);
+        }
+    }
+
+    if (ac.conds && !ac.condvec.empty())
+    {
+        // the origins are stepped by the extent of the first condition
+        const Condition *c = &ac.condvec[0];
+        const FilterInfo& finfo = g_filterinfo.list[c->type];
+        int64_t sx = c->x2 - c->x1, sz = c->z2 - c->z1;
+        if (sx < 1) sx = 1;
+        if (sz < 1) sz = 1;
+        if (finfo.step > 1)
+        {
+            sx *= finfo.step;
+            sz *= finfo.step;
+        }
+        else if (finfo.stype > 0)
+        {
+            if (sx < 16) sx = 16;
+            if (sz < 16) sz = 16;
+        }
+        cstepx = sx;
+        cstepz = sz;
+
+        // origins on the step grid, within a step around the area
+        int64_t xr1 = sx * (int64_t) floor((ac.x1 - sx) / (double) sx);
+        int64_t zr1 = sz * (int64_t) floor((ac.z1 - sz) / (double) sz);
+        int64_t xr2 = std::min<int64_t>((int64_t)ac.x2 + sx, INT_MAX);
+        int64_t zr2 = std::min<int64_t>((int64_t)ac.z2 + sz, INT_MAX);
+        xr1 = std::max<int64_t>(xr1, INT_MIN);
+        zr1 = std::max<int64_t>(zr1, INT_MIN);
+        for (int64_t x = xr1; x <= xr2; x += COND_TILE * sx)
+        {
+            for (int64_t z = zr1; z <= zr2; z += COND_TILE * sz)
+            {
+                AnalysisTask t;
+                t.type = TASK_CONDS;
+                t.opt = 0;
+                t.x0 = (int) x;
+                t.z0 = (int) z;
+                t.x1 = (int) std::min<int64_t>(x + (COND_TILE-1) * sx, xr2);
+                t.z1 = (int) std::min<int64_t>(z + (COND_TILE-1) * sz, zr2);
+                tasks.push_back(t);
+            }
+        }
+    }
+
+    int total = tasks.size();
+    emit progress(0, total);
+
+    QThreadPool pool;
+    int n = QThread::idealThreadCount();
+    if (n > total)
+        n = total;
+    pool.setMaxThreadCount(n > 0 ? n : 1);
+    for (int i = 0; i < n; i++)
+        pool.start(new AnalysisWorker(this));
+
+    // report the progress and the biome counts while the workers run
+    bool running = true;
+    while (running)
+    {
+        running = !pool.waitForDone(200);
+
+        emit progress(done, total);
+
+        QVector<qint64> cnt;
+        QVector<double> frac, ci95;
+        {
+            QMutexLocker locker(&mutex);
+            if (idchanged && ac.samples > 0 && wsum > 0)
+            {
+                frac.resize(256);
+                ci95.resize(256);
+                for (int i = 0; i < 256; i++)
+                {
+                    frac[i] = idest[i] / wsum;
+                    ci95[i] = 1.96 * sqrt(idvar[i]) / wsum;
+                }
+            }
+            else if (idchanged)
+            {
+                cnt.resize(256);
+                for (int i = 0; i < 256; i++)
+                    cnt[i] = idcnt[i];
+            }
+            idchanged = false;
+        }
+        if (!cnt.empty())
+            emit biomesCounted(cnt);
+        if (!frac.empty())
+            emit biomesSampled(frac, ci95);
+    }
+
+    if (exportfile.isOpen())
+    {
+        if (!exportfile.flush())
+            exporterr = true;
+        exportfile.close();
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QVector>
+#include <QSet>
+#include <QByteArray>
+#include <QFile>
+
+#include <atomic>
+#include <vector>
+
+#include "settings.h"
+#include "search.h"
+#include "quad.h"
+
+
+struct AnalysisConfig
+{
+    WorldInfo wi;
+    int x1, z1, x2, z2;     // area (inclusive)
+    int dim;                // dimension of the map
+    bool mapOnly;           // restrict to the dimension and options of the map
+    bool show[STRUCT_NUM];  // structure options of the map
+    bool biomes;
+    int scale;              // biome sampling scale (1, 4, 16 or 64)
+    int samples;            // random samples per biome section, 0 counts every cell
+    bool structs;
+    int streamSample;       // structures listed per type when streaming to a file
+    bool conds;
+    QVector<Condition> condvec;
+};
+
+// structure location, with the variant flag (abandoned villages)
+struct StructLoc
+{
+    Pos p;
+    int variant;
+};
+
+// location that satisfies the conditions, with the condition centers
+struct CondLoc
+{
+    Pos origin;
+    QVector<Pos> cpos;
+};
+
+Q_DECLARE_METATYPE(StructLoc)
+Q_DECLARE_METATYPE(CondLoc)
+
+struct AnalysisTask;
+
+/* Background engine for the area analysis.
+ * The area is split into tiles that are processed by a pool of workers, each
+ * holding its own generators, which are seeded once per dimension. Results
+ * are reported as they become available.
+ */
+class AnalysisThread : public QThread
+{
+    Q_OBJECT
+public:
+    AnalysisThread(QObject *parent = nullptr);
+    ~AnalysisThread();
+
+    void set(const AnalysisConfig& ac);
+    // stream the structures of the next run to a file (CSV, or binary for *.bin)
+    bool openExport(QString path);
+    virtual void run() override;
+    void stop() { abort = true; }
+
+signals:
+    void progress(int done, int total);
+    // biome counts of the processed part of the area (cumulative)
+    void biomesCounted(QVector<qint64> idcnt);
+    // sampled biome area fractions with the half widths of their 95% confidence
+    // intervals, for the processed part of the area (cumulative)
+    void biomesSampled(QVector<double> frac, QVector<double> ci95);
+    // structures of one map option (D_*) in a section of the area
+    void structsFound(int sopt, QVector<StructLoc> locs);
+    // structures of one map option that were streamed to the export file, with
+    // the total count so far and the new entries of the capped sample
+    void structsStreamed(int sopt, qint64 total, QVector<StructLoc> sample);
+    void condsFound(QVector<CondLoc> locs);
+    // the maximum number of condition locations has been reached
+    void condsLimit(int cnt);
+
+public:
+    AnalysisConfig          ac;
+    std::vector<AnalysisTask> tasks;
+    std::atomic_int         next;       // next task to be processed
+    std::atomic_int         done;       // completed tasks
+    std::atomic_bool        abort;
+
+    QMutex                  mutex;
+    qint64                  idcnt[256]; // guarded by mutex
+    double                  idest[256]; // stratified estimates (guarded by mutex)
+    double                  idvar[256];
+    double                  wsum;       // sampled fraction of the area
+    bool                    idchanged;
+    double                  biomearea;  // total area of the biome sections
+    std::atomic_int         condcnt;
+    int64_t                 cstepx;     // step between condition origins
+    int64_t                 cstepz;
+    QSet<QByteArray>        condseen;   // reported layouts (guarded by mutex)
+
+    QMutex                  exportmutex;
+    QFile                   exportfile; // open while structures are streamed
+    bool                    exportbin;
+    bool                    exporterr;
+    qint64                  scnt[STRUCT_NUM];   // guarded by exportmutex
+    int                     ssampled[STRUCT_NUM];
+};
+
+#endif // ANALYSIS_H
@@ -0,0 +1,158 @@
+#include "quad.h"
+#include "search.h"
+#include "cutil.h"
+
+#include "cubiomes/generator.h"
+#include "cubiomes/util.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+
+#include <stdio.h>
+#include <vector>
+
+unsigned char biomeColors[256][3];
+unsigned char tempsColors[256][3];
+
+
+static bool parseWorld(QCommandLineParser& parser, WorldInfo *wi)
+{
+    if (parser.isSet("mc"))
+    {
+        const std::string& mcs = parser.value("mc").toStdString();
+        wi->mc = str2mc(mcs.c_str());
+        if (wi->mc < 0)
+        {
+            fprintf(stderr, "Unknown MC version: %s\n", mcs.c_str());
+            return false;
+        }
+    }
+    wi->large = parser.isSet("large");
+    str2seed(parser.value("seed"), &wi->seed);
+    return true;
+}
+
+/* Throughput of the biome tile generation, e.g.:
+ *  cubiomes-bench tiles --mc 1.18 --scale 4 --tiles 64
+ * The map tiles are generated as exact squares, and for comparison with the
+ * seam border of 8 cells that they were previously generated with. The tile
+ * cache is not involved.
+ */
+static int benchTiles(QCommandLineParser& parser)
+{
+    WorldInfo wi;
+    if (!parseWorld(parser, &wi))
+        return 1;
+    int scale = parser.value("scale").toInt();
+    int ntiles = std::max(1, parser.value("n").toInt());
+    int y = (scale > 1) ? wi.y >> 2 : wi.y;
+    int pixs = mapTilePixels(wi.mc);
+
+    Generator g;
+    setupGenerator(&g, wi.mc, mapGenFlags(wi));
+    applySeed(&g, 0, wi.seed);
+
+    const int border[] = { 0, 8 };
+    for (int pad : border)
+    {
+        int n = pixs + pad;
+        Range r = {scale, 0, 0, n, n, y, 1};
+        int *ids = allocCache(&g, r);
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < ntiles; i++)
+        {
+            // a row of tiles as the map would generate them
+            r.x = i * pixs;
+            if (genBiomes(&g, ids, r))
+            {
+                fprintf(stderr, "Failed to generate biomes at scale 1:%d\n", scale);
+                free(ids);
+                return 1;
+            }
+        }
+        qint64 ns = timer.nsecsElapsed();
+        free(ids);
+        double sec = ns * 1e-9;
+        printf("%dx%d cells (border %d): %.2f tiles/s, %.2f Mcells/s\n",
+            n, n, pad, ntiles / sec, (double)n * n * ntiles / sec * 1e-6);
+    }
+    return 0;
+}
+
+/* Structure attempt positions of a block of seeds, evaluated per seed with
+ * getStructurePos and with getStructurePosBatch as in the search, e.g.:
+ *  cubiomes-bench structs --mc 1.18 --n 1000000
+ */
+static int benchStructs(QCommandLineParser& parser)
+{
+    WorldInfo wi;
+    if (!parseWorld(parser, &wi))
+        return 1;
+    int nseeds = std::max(4, parser.value("n").toInt());
+
+    std::vector<uint64_t> seeds(nseeds);
+    for (int i = 0; i < nseeds; i++)
+        seeds[i] = (wi.seed + i * 0x9E3779B97F4A7C15ULL) & MASK48;
+    std::vector<Pos> pos(nseeds);
+    std::vector<char> ok(nseeds);
+
+    for (int st = 0; st < FEATURE_NUM; st++)
+    {
+        StructureConfig sconf;
+        if (!getStructureConfig_override(st, wi.mc, &sconf))
+            continue;
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < nseeds; i++)
+            ok[i] = getStructurePos(st, wi.mc, seeds[i], 1, -1, &pos[i]);
+        double tscalar = timer.nsecsElapsed() * 1e-9;
+
+        timer.restart();
+        // blocks of the same size as the search uses (STRUCT_BLOCK)
+        for (int i = 0; i < nseeds; i += 64)
+        {
+            int n = std::min(64, nseeds - i);
+            getStructurePosBatch(st, wi.mc, &seeds[i], n, 1, -1, &pos[i], &ok[i]);
+        }
+        double tbatch = timer.nsecsElapsed() * 1e-9;
+
+        printf("%-16s scalar: %7.2f Mseeds/s, batch: %7.2f Mseeds/s (%.2fx)\n",
+            struct2str(st), nseeds / tscalar * 1e-6, nseeds / tbatch * 1e-6,
+            tscalar / tbatch);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    initBiomes();
+    initBiomeColors(biomeColors);
+    initBiomeTypeColors(tempsColors);
+
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("cubiomes-viewer benchmarks");
+    parser.addHelpOption();
+    parser.addPositionalArgument("mode", "Benchmark to run: tiles or structs.");
+    parser.addOptions({
+        {"seed", "World seed (default: 0).", "seed", "0"},
+        {"mc", "Minecraft version (default: newest).", "version"},
+        {"large", "Large biomes."},
+        {"scale", "Biome scale: 1, 4, 16, 64 or 256 (default: 4).", "scale", "4"},
+        {"n", "Tiles or seeds per run (default: 64).", "n", "64"},
+    });
+    parser.process(app);
+
+    QStringList args = parser.positionalArguments();
+    QString mode = args.isEmpty() ? QString() : args.first();
+    if (mode == "tiles")
+        return benchTiles(parser);
+    if (mode == "structs")
+        return benchStructs(parser);
+
+    parser.showHelp(1);
+    return 1;
+}
@@ -22,6 +22,10 @@ ConfigDialog::ConfigDialog(QWidget *parent, Config *config) :
     for (int i = 0; i < 16; i++)
         ui->cboxItemSize->addItem(QString::number(1 << i));
     ui->lineGridSpacing->setValidator(new QIntValidator(0, 1048576, ui->lineQueueSize));
+    ui->lineMapCache->setValidator(new QIntValidator(0, 1048576, ui->lineMapCache));
+    ui->linePrefetch->setValidator(new QIntValidator(0, 4096, ui->linePrefetch));
+    ui->lineMapThreads->setValidator(new QIntValidator(0, 9999, ui->lineMapThreads));
+    ui->lineMapMemory->setValidator(new QIntValidator(16, 1048576, ui->lineMapMemory));
 
     initSettings(config);
 }
@@ -44,6 +48,10 @@ void ConfigDialog::initSettings(Config *config)
     ui->lineQueueSize->setText(QString::number(config->queueSize));
     ui->lineMatching->setText(QString::number(config->maxMatching));
     ui->lineGridSpacing->setText(config->gridSpacing ? QString::number(config->gridSpacing) : "");
+    ui->lineMapCache->setText(QString::number(config->mapCacheSize));
+    ui->linePrefetch->setText(QString::number(config->prefetchTiles));
+    ui->lineMapThreads->setText(config->mapThreads ? QString::number(config->mapThreads) : "");
+    ui->lineMapMemory->setText(QString::number(config->mapMemory));
 
     setBiomeColorPath(config->biomeColorPath);
 }
@@ -59,10 +67,15 @@ Config ConfigDialog::getSettings()
     conf.queueSize = ui->lineQueueSize->text().toInt();
     conf.maxMatching = ui->lineMatching->text().toInt();
     conf.gridSpacing = ui->lineGridSpacing->text().toInt();
+    conf.mapCacheSize = ui->lineMapCache->text().toInt();
+    conf.prefetchTiles = ui->linePrefetch->text().toInt();
+    conf.mapThreads = ui->lineMapThreads->text().toInt();
+    conf.mapMemory = ui->lineMapMemory->text().toInt();
 
     if (!conf.seedsPerItem) conf.seedsPerItem = 1024;
     if (!conf.queueSize) conf.queueSize = QThread::idealThreadCount();
     if (!conf.maxMatching) conf.maxMatching = 65536;
+    if (conf.mapMemory < 16) conf.mapMemory = 16;
 
     return conf;
 }
@@ -281,6 +281,7 @@ FilterDialog::FilterDialog(FormConditions *parent, Config *config, int mcversion
         ui->lineEditZ2->setText(QString::number(cond.z2));
 
         ui->checkApprox->setChecked(cond.approx);
+        ui->checkFirstOnly->setChecked(cond.flags & Condition::FLG_FIRST_ONLY);
         ui->lineY->setText(QString::number(cond.y));
 
         if (cond.x1 == cond.z1 && cond.x1 == -cond.x2 && cond.x1 == -cond.z2)
@@ -382,8 +383,11 @@ void FilterDialog::updateMode()
     ui->lineEditX2->setEnabled(custom && ft.area);
     ui->lineEditZ2->setEnabled(custom && ft.area);
 
-    ui->labelSpinBox->setEnabled(ft.count);
-    ui->spinBox->setEnabled(ft.count);
+    bool firstonly = filterindex == F_STRONGHOLD && ui->checkFirstOnly->isChecked();
+    ui->checkFirstOnly->setEnabled(filterindex == F_STRONGHOLD);
+
+    ui->labelSpinBox->setEnabled(ft.count && !firstonly);
+    ui->spinBox->setEnabled(ft.count && !firstonly);
 
     ui->labelY->setEnabled(ft.hasy);
     ui->lineY->setEnabled(ft.hasy);
@@ -723,6 +727,13 @@ void FilterDialog::on_buttonOk_clicked()
 
     cond.approx = ui->checkApprox->isChecked();
 
+    cond.flags = 0;
+    if (ui->checkFirstOnly->isEnabled() && ui->checkFirstOnly->isChecked())
+    {
+        cond.flags |= Condition::FLG_FIRST_ONLY;
+        cond.count = 1;
+    }
+
     cond.variants = 0;
     cond.variants |= ui->checkStartPiece->isChecked() * Condition::START_PIECE_MASK;
     cond.variants |= ui->checkAbandoned->isChecked() * Condition::ABANDONED_MASK;
@@ -791,3 +802,8 @@ void FilterDialog::on_checkStartPiece_stateChanged(int state)
     ui->scrollVariants->setEnabled(state);
 }
 
+void FilterDialog::on_checkFirstOnly_toggled(bool)
+{
+    updateMode();
+}
+
@@ -113,6 +113,8 @@ private slots:
 
     void on_checkStartPiece_stateChanged(int state);
 
+    void on_checkFirstOnly_toggled(bool checked);
+
 private:
     Ui::FilterDialog *ui;
     QTextEdit *textDescription;
@@ -4,6 +4,7 @@
 #include "mainwindow.h"
 #include "search.h"
 #include "rangedialog.h"
+#include "seedpreviewdialog.h"
 
 #include <QMessageBox>
 #include <QMenu>
@@ -293,6 +294,9 @@ void FormSearchControl::on_listResults_customContextMenuRequested(const QPoint &
     QAction *actcopy = menu.addAction(QIcon::fromTheme("edit-copy"), "将整个列表复制到剪贴板", this, &FormSearchControl::copyResults);
     actcopy->setEnabled(ui->listResults->rowCount() > 0);
 
+    QAction *actpreview = menu.addAction(QIcon::fromTheme("view-preview"), "预览所有种子的缩略图", this, &FormSearchControl::showPreviews);
+    actpreview->setEnabled(ui->listResults->rowCount() > 0);
+
     int n = pasteList(true);
     QAction *actpaste = menu.addAction(QIcon::fromTheme("edit-paste"), QString::asprintf("从剪贴板粘贴 %d 个种子", n), this, &FormSearchControl::pasteResults);
     actpaste->setEnabled(n > 0);
@@ -533,3 +537,10 @@ void FormSearchControl::copyResults()
     QClipboard *clipboard = QGuiApplication::clipboard();
     clipboard->setText(text);
 }
+
+void FormSearchControl::showPreviews()
+{
+    SeedPreviewDialog *dialog = new SeedPreviewDialog(parent, getResults());
+    connect(dialog, &SeedPreviewDialog::seedSelected, this, &FormSearchControl::selectedSeedChanged);
+    dialog->show();
+}
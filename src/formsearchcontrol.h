@@ -60,6 +60,7 @@ public slots:
     void resultTimeout();
     void removeCurrent();
     void copyResults();
+    void showPreviews();
 
 private:
     MainWindow *parent;
@@ -1,25 +1,151 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
 
 #include "quad.h"
+#include "tilecache.h"
+#include "mapexport.h"
+#include "cutil.h"
 
 #include "cubiomes/generator.h"
 #include "cubiomes/util.h"
 
+#include <stdio.h>
+#include <string.h>
+
 unsigned char biomeColors[256][3];
 unsigned char tempsColors[256][3];
 
+
+/* Headless map export, e.g.:
+ *  cubiomes-viewer --export map.tif --seed 123 --mc 1.18 --scale 16
+ *      --area -50000,-50000,50000,50000 --structs village,monument
+ */
+static int runExport(QCoreApplication& app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Map image export");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"export", "Output image file (BigTIFF).", "file"},
+        {"seed", "World seed.", "seed"},
+        {"mc", "Minecraft version (default: newest).", "version"},
+        {"large", "Large biomes."},
+        {"dim", "Dimension: 0, -1 or 1 (default: 0).", "dim", "0"},
+        {"y", "Vertical layer for 3D biomes (default: 63).", "y", "63"},
+        {"scale", "Blocks per pixel: 1, 4, 16, 64 or 256 (default: 16).", "scale", "16"},
+        {"area", "Area in blocks.", "x0,z0,x1,z1"},
+        {"structs", "Structures to draw, e.g. village,monument.", "list"},
+    });
+    parser.process(app);
+
+    MapExportConfig ec;
+    ec.path = parser.value("export");
+    if (!parser.isSet("seed"))
+    {
+        fprintf(stderr, "Expected --seed\n");
+        return 1;
+    }
+    ec.wi.mc = MC_NEWEST;
+    if (parser.isSet("mc"))
+    {
+        const std::string& mcs = parser.value("mc").toStdString();
+        ec.wi.mc = str2mc(mcs.c_str());
+        if (ec.wi.mc < 0)
+        {
+            fprintf(stderr, "Unknown MC version: %s\n", mcs.c_str());
+            return 1;
+        }
+    }
+    ec.wi.large = parser.isSet("large");
+    str2seed(parser.value("seed"), &ec.wi.seed);
+    ec.wi.y = parser.value("y").toInt();
+    ec.dim = parser.value("dim").toInt();
+    ec.scale = parser.value("scale").toInt();
+
+    QStringList area = parser.value("area").split(',');
+    bool ok = area.size() == 4;
+    int a[4] = {};
+    for (int i = 0; i < 4 && ok; i++)
+        a[i] = area[i].trimmed().toInt(&ok);
+    if (!ok)
+    {
+        fprintf(stderr, "Expected --area x0,z0,x1,z1\n");
+        return 1;
+    }
+    ec.x0 = std::min(a[0], a[2]);
+    ec.z0 = std::min(a[1], a[3]);
+    ec.x1 = std::max(a[0], a[2]);
+    ec.z1 = std::max(a[1], a[3]);
+
+    for (int sopt = 0; sopt < STRUCT_NUM; sopt++)
+        ec.show[sopt] = false;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    QStringList structs = parser.value("structs").split(',', Qt::SkipEmptyParts);
+#else
+    QStringList structs = parser.value("structs").split(',', QString::SkipEmptyParts);
+#endif
+    for (QString s : structs)
+    {
+        int sopt;
+        for (sopt = D_DESERT; sopt < STRUCT_NUM; sopt++)
+            if (s.trimmed() == mapopt2str(sopt))
+                break;
+        if (sopt == STRUCT_NUM)
+        {
+            fprintf(stderr, "Unknown structure: %s\n", qPrintable(s));
+            return 1;
+        }
+        ec.show[sopt] = true;
+    }
+
+    // the same structure salts, biome colors and tile cache as the GUI
+    QSettings settings("cubiomes-viewer", "cubiomes-viewer");
+    Config config;
+    MainWindow::loadExtGen(&settings);
+    MainWindow::loadBiomeColors(settings.value("config/biomeColorPath", config.biomeColorPath).toString());
+    config.mapCacheSize = settings.value("config/mapCacheSize", config.mapCacheSize).toInt();
+    g_tilecache.setMaxSize((qint64)config.mapCacheSize << 20);
+    g_tilecache.flush(); // the index, so the first tiles are found
+
+    std::atomic_bool abort(false);
+    QString err;
+    ok = exportMapImage(ec, &abort, [](int done, int total) {
+        fprintf(stderr, "\r%d / %d", done, total);
+        fflush(stderr);
+    }, &err);
+    fprintf(stderr, "\n");
+    g_tilecache.flush();
+    if (!ok)
+    {
+        fprintf(stderr, "Export failed: %s\n", qPrintable(err));
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     initBiomes();
     initBiomeColors(biomeColors);
     initBiomeTypeColors(tempsColors);
 
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--export") == 0)
+        {
+            // no display is needed for the export
+            QCoreApplication app(argc, argv);
+            return runExport(app);
+        }
+    }
+
     QApplication a(argc, argv);
 
     MainWindow mw;
     mw.show();
     int ret = a.exec();
+    g_tilecache.flush();
 
     return ret;
 }
@@ -7,9 +7,13 @@
 #include "protobasedialog.h"
 #include "filterdialog.h"
 #include "extgendialog.h"
+#include "mapexportdialog.h"
 
 #include "quad.h"
 #include "cutil.h"
+#include "tilecache.h"
+#include "tilescheduler.h"
+#include "maptrace.h"
 
 #include <QIntValidator>
 #include <QMetaType>
@@ -179,6 +183,10 @@ MainWindow::MainWindow(QWidget *parent)
     qRegisterMetaType< uint64_t >("uint64_t");
     qRegisterMetaType< QVector<uint64_t> >("QVector<uint64_t>");
     qRegisterMetaType< Config >("Config");
+    qRegisterMetaType< QVector<qint64> >("QVector<qint64>");
+    qRegisterMetaType< QVector<double> >("QVector<double>");
+    qRegisterMetaType< QVector<StructLoc> >("QVector<StructLoc>");
+    qRegisterMetaType< QVector<CondLoc> >("QVector<CondLoc>");
 
     QIntValidator *intval = new QIntValidator(this);
     ui->lineRadius->setValidator(intval);
@@ -195,12 +203,28 @@ MainWindow::MainWindow(QWidget *parent)
     connect(&autosaveTimer, &QTimer::timeout, this, &MainWindow::onAutosaveTimeout);
 
     ui->treeAnalysis->sortByColumn(0, Qt::AscendingOrder);
+    ui->progressAnalysis->setVisible(false);
+    ui->spinSamples->setEnabled(false);
+    connect(ui->checkBiomeSample, &QCheckBox::toggled, ui->spinSamples, &QWidget::setEnabled);
+    ui->spinStreamSample->setEnabled(false);
+    connect(ui->checkStreamExport, &QCheckBox::toggled, ui->spinStreamSample, &QWidget::setEnabled);
+
+    connect(&analysis, &AnalysisThread::progress, this, &MainWindow::onAnalysisProgress, Qt::QueuedConnection);
+    connect(&analysis, &AnalysisThread::biomesCounted, this, &MainWindow::onAnalysisBiomes, Qt::QueuedConnection);
+    connect(&analysis, &AnalysisThread::biomesSampled, this, &MainWindow::onAnalysisSampled, Qt::QueuedConnection);
+    connect(&analysis, &AnalysisThread::structsFound, this, &MainWindow::onAnalysisStructs, Qt::QueuedConnection);
+    connect(&analysis, &AnalysisThread::structsStreamed, this, &MainWindow::onAnalysisStreamed, Qt::QueuedConnection);
+    connect(&analysis, &AnalysisThread::condsFound, this, &MainWindow::onAnalysisConds, Qt::QueuedConnection);
+    connect(&analysis, &AnalysisThread::condsLimit, this, &MainWindow::onAnalysisLimit, Qt::QueuedConnection);
+    connect(&analysis, &QThread::finished, this, &MainWindow::onAnalysisFinished, Qt::QueuedConnection);
 
     loadSettings();
 }
 
 MainWindow::~MainWindow()
 {
+    analysis.stop();
+    analysis.wait();
     saveSettings();
     delete ui;
 }
@@ -298,6 +322,11 @@ void MainWindow::saveSettings()
     settings.setValue("analysis/biomes", ui->checkBiomes->isChecked());
     settings.setValue("analysis/conditions", ui->checkConditions->isChecked());
     settings.setValue("analysis/maponly", ui->checkMapOnly->isChecked());
+    settings.setValue("analysis/biomescale", ui->comboBiomeScale->currentIndex());
+    settings.setValue("analysis/sampling", ui->checkBiomeSample->isChecked());
+    settings.setValue("analysis/samples", ui->spinSamples->value());
+    settings.setValue("analysis/stream", ui->checkStreamExport->isChecked());
+    settings.setValue("analysis/streamsample", ui->spinStreamSample->value());
     settings.setValue("analysis/customarea", ui->checkArea->isChecked());
     settings.setValue("analysis/x1", ui->lineEditX1->text().toInt());
     settings.setValue("analysis/z1", ui->lineEditZ1->text().toInt());
@@ -313,6 +342,10 @@ void MainWindow::saveSettings()
     settings.setValue("config/queueSize", config.queueSize);
     settings.setValue("config/maxMatching", config.maxMatching);
     settings.setValue("config/gridSpacing", config.gridSpacing);
+    settings.setValue("config/mapCacheSize", config.mapCacheSize);
+    settings.setValue("config/prefetchTiles", config.prefetchTiles);
+    settings.setValue("config/mapThreads", config.mapThreads);
+    settings.setValue("config/mapMemory", config.mapMemory);
     settings.setValue("config/biomeColorPath", config.biomeColorPath);
 
     settings.setValue("world/saltOverride", g_extgen.saltOverride);
@@ -370,6 +403,11 @@ void MainWindow::loadSettings()
     loadCheck(&settings, ui->checkBiomes, "analysis/biomes");
     loadCheck(&settings, ui->checkConditions, "analysis/conditions");
     loadCheck(&settings, ui->checkMapOnly, "analysis/maponly");
+    ui->comboBiomeScale->setCurrentIndex(settings.value("analysis/biomescale", ui->comboBiomeScale->currentIndex()).toInt());
+    loadCheck(&settings, ui->checkBiomeSample, "analysis/sampling");
+    ui->spinSamples->setValue(settings.value("analysis/samples", ui->spinSamples->value()).toInt());
+    loadCheck(&settings, ui->checkStreamExport, "analysis/stream");
+    ui->spinStreamSample->setValue(settings.value("analysis/streamsample", ui->spinStreamSample->value()).toInt());
     loadCheck(&settings, ui->checkArea, "analysis/customarea");
     loadLine(&settings, ui->lineEditX1, "analysis/x1");
     loadLine(&settings, ui->lineEditZ1, "analysis/z1");
@@ -385,6 +423,10 @@ void MainWindow::loadSettings()
     config.queueSize = settings.value("config/queueSize", config.queueSize).toInt();
     config.maxMatching = settings.value("config/maxMatching", config.maxMatching).toInt();
     config.gridSpacing = settings.value("config/gridSpacing", config.gridSpacing).toInt();
+    config.mapCacheSize = settings.value("config/mapCacheSize", config.mapCacheSize).toInt();
+    config.prefetchTiles = settings.value("config/prefetchTiles", config.prefetchTiles).toInt();
+    config.mapThreads = settings.value("config/mapThreads", config.mapThreads).toInt();
+    config.mapMemory = settings.value("config/mapMemory", config.mapMemory).toInt();
     config.biomeColorPath = settings.value("config/biomeColorPath", config.biomeColorPath).toString();
 
     if (!config.biomeColorPath.isEmpty())
@@ -393,14 +435,13 @@ void MainWindow::loadSettings()
     ui->mapView->setShowBB(config.showBBoxes);
     ui->mapView->setSmoothMotion(config.smoothMotion);
     ui->mapView->setSetGridSpacing(config.gridSpacing);
+    ui->mapView->setPrefetch(config.prefetchTiles);
+    ui->mapView->setMemoryBudget((qint64)config.mapMemory << 20);
+    g_mapsched.setThreadCount(config.mapThreads);
+    g_tilecache.setMaxSize((qint64)config.mapCacheSize << 20);
     onStyleChanged(config.uistyle);
 
-    g_extgen.saltOverride = settings.value("world/saltOverride", g_extgen.saltOverride).toBool();
-    for (int st = 0; st < FEATURE_NUM; st++)
-    {
-        QVariant v = QVariant::fromValue(~(qulonglong)0);
-        g_extgen.salts[st] = settings.value(QString("world/salt_") + struct2str(st), v).toULongLong();
-    }
+    loadExtGen(&settings);
 
     int dim = settings.value("map/dim", getDim()).toInt();
     if (dim == -1)
@@ -723,6 +764,10 @@ void MainWindow::on_actionPreferences_triggered()
         ui->mapView->setShowBB(config.showBBoxes);
         ui->mapView->setSmoothMotion(config.smoothMotion);
         ui->mapView->setSetGridSpacing(config.gridSpacing);
+        ui->mapView->setPrefetch(config.prefetchTiles);
+        ui->mapView->setMemoryBudget((qint64)config.mapMemory << 20);
+        g_mapsched.setThreadCount(config.mapThreads);
+        g_tilecache.setMaxSize((qint64)config.mapCacheSize << 20);
         if (oldConfig.uistyle != config.uistyle)
             onStyleChanged(config.uistyle);
 
@@ -743,9 +788,25 @@ void MainWindow::on_actionPreferences_triggered()
     }
 }
 
+void MainWindow::loadExtGen(QSettings *settings)
+{
+    g_extgen.saltOverride = settings->value("world/saltOverride", g_extgen.saltOverride).toBool();
+    for (int st = 0; st < FEATURE_NUM; st++)
+    {
+        QVariant v = QVariant::fromValue(~(qulonglong)0);
+        g_extgen.salts[st] = settings->value(QString("world/salt_") + struct2str(st), v).toULongLong();
+    }
+}
+
 void MainWindow::onBiomeColorChange()
 {
-    QFile file(config.biomeColorPath);
+    loadBiomeColors(config.biomeColorPath);
+    ui->mapView->refreshBiomeColors();
+}
+
+void MainWindow::loadBiomeColors(QString path)
+{
+    QFile file(path);
     if (file.open(QIODevice::ReadOnly))
     {
         char buf[32*1024];
@@ -762,7 +823,6 @@ void MainWindow::onBiomeColorChange()
     {
         initBiomeColors(biomeColors);
     }
-    ui->mapView->refresh();
 }
 
 void MainWindow::on_actionGo_to_triggered()
@@ -777,6 +837,34 @@ void MainWindow::on_actionScan_seed_for_Quad_Huts_triggered()
     dialog->show();
 }
 
+void MainWindow::on_actionExport_map_image_triggered()
+{
+    MapExportDialog *dialog = new MapExportDialog(this);
+    dialog->show();
+}
+
+void MainWindow::on_actionRender_stats_toggled(bool checked)
+{
+    ui->mapView->setShowStats(checked);
+}
+
+void MainWindow::on_actionExport_render_trace_triggered()
+{
+    if (!g_maptrace.isEnabled())
+    {
+        warning("警告", "请先启用渲染统计，再浏览地图以记录跟踪");
+        return;
+    }
+    QString fnam = QFileDialog::getSaveFileName(this, "导出渲染跟踪", prevdir,
+        "Chrome trace (*.json);;Any files (*)");
+    if (fnam.isEmpty())
+        return;
+    prevdir = QFileInfo(fnam).absolutePath();
+    QString err;
+    if (!g_maptrace.exportJson(fnam, &err))
+        warning("警告", err);
+}
+
 void MainWindow::on_actionOpen_shadow_seed_triggered()
 {
     WorldInfo wi;
@@ -852,6 +940,12 @@ void MainWindow::on_checkArea_toggled(bool checked)
 
 void MainWindow::on_lineRadius_editingFinished()
 {
+    if (analysis.isRunning())
+    {   // restart with the new area
+        analysis.stop();
+        analysis.wait();
+        QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+    }
     on_buttonAnalysis_clicked();
 }
 
@@ -873,6 +967,12 @@ void MainWindow::on_buttonFromVisible_clicked()
 
 void MainWindow::on_buttonAnalysis_clicked()
 {
+    if (analysis.isRunning())
+    {
+        analysis.stop();
+        return;
+    }
+
     int x1, z1, x2, z2;
 
     if (ui->lineRadius->isEnabled())
@@ -896,53 +996,39 @@ void MainWindow::on_buttonAnalysis_clicked()
         return;
     }
 
-    bool ck_struct = ui->checkStructs->isChecked();
-    bool ck_biome = ui->checkBiomes->isChecked();
-    bool ck_conds = ui->checkConditions->isChecked();
-    bool map_only = ui->checkMapOnly->isChecked();
+    AnalysisConfig ac;
+    ac.x1 = x1;
+    ac.z1 = z1;
+    ac.x2 = x2;
+    ac.z2 = z2;
+    ac.structs = ui->checkStructs->isChecked();
+    ac.streamSample = ui->spinStreamSample->value();
+    ac.biomes = ui->checkBiomes->isChecked();
+    ac.conds = ui->checkConditions->isChecked();
+    ac.mapOnly = ui->checkMapOnly->isChecked();
+    ac.scale = 1 << (2 * ui->comboBiomeScale->currentIndex());
+    ac.samples = ui->checkBiomeSample->isChecked() ? ui->spinSamples->value() : 0;
+    ac.dim = getDim();
+    for (int sopt = 0; sopt < STRUCT_NUM; sopt++)
+        ac.show[sopt] = getMapView()->getShow(sopt);
 
     QTreeWidget *tree = ui->treeAnalysis;
     while (tree->topLevelItemCount() > 0)
         delete tree->takeTopLevelItem(0);
 
-
-    WorldInfo wi;
-    if (!getSeed(&wi))
+    if (!getSeed(&ac.wi))
         return;
 
-    QVector<Condition> conds;
-    if (ck_conds)
-        conds = formCond->getConditions();
+    if (ac.conds)
+        ac.condvec = formCond->getConditions();
 
     uint64_t areasiz = (uint64_t)(x2 - x1) * (uint64_t)(z2 - z1);
-    int64_t cstepx = 1, cstepz = 1;
 
     bool areawarn = false;
-    if (ck_struct && areasiz > 1e10)
+    if (ac.structs && areasiz > 1e10)
         areawarn = true;
-    if (ck_biome && areasiz > 1e8)
+    if (ac.biomes && ac.samples == 0 && areasiz / (ac.scale * ac.scale) > 1e8)
         areawarn = true;
-    if (ck_conds && !conds.empty())
-    {
-        Condition *c = &conds[0];
-        const FilterInfo& finfo = g_filterinfo.list[c->type];
-        cstepx = (c->x2 - c->x1);
-        cstepz = (c->z2 - c->z1);
-
-        if (cstepx < 1) cstepx = 1;
-        if (cstepz < 1) cstepz = 1;
-
-        if (finfo.step > 1)
-        {
-            cstepx *= finfo.step;
-            cstepz *= finfo.step;
-        }
-        else if (finfo.stype > 0)
-        {
-            if (cstepx < 16) cstepx = 16;
-            if (cstepz < 16) cstepz = 16;
-        }
-    }
 
     if (areawarn)
     {
@@ -953,260 +1039,201 @@ void MainWindow::on_buttonAnalysis_clicked()
         int button = QMessageBox::warning(this, "警告", msg, QMessageBox::Cancel, QMessageBox::Yes);
         if (button != QMessageBox::Yes)
             return;
-
-        // update to close message box
-        update();
-        QApplication::processEvents();
     }
 
-    ui->buttonAnalysis->setEnabled(false);
+    analysis.set(ac);
+
+    if (ac.structs && ui->checkStreamExport->isChecked())
+    {
+        QString fnam = QFileDialog::getSaveFileName(this, "Export structures", prevdir,
+            "Text files (*.txt *csv);;Binary files (*.bin);;Any files (*)");
+        if (fnam.isEmpty())
+            return;
+        prevdir = QFileInfo(fnam).absolutePath();
+        if (!analysis.openExport(fnam))
+        {
+            warning("警告", "打开文件失败");
+            return;
+        }
+    }
 
+    ui->buttonAnalysis->setText("停止分析");
+    ui->buttonExport->setEnabled(false);
+    ui->progressAnalysis->setValue(0);
+    ui->progressAnalysis->setFormat("");
+    ui->progressAnalysis->setVisible(true);
 
-    int dim = getDim();
-    Generator g;
-    setupGenerator(&g, wi.mc, wi.large);
+    analysis.start();
+}
 
-    if (ck_biome)
+QTreeWidgetItem *MainWindow::getAnalysisCategory(QString name)
+{
+    QTreeWidget *tree = ui->treeAnalysis;
+    for (int i = 0, n = tree->topLevelItemCount(); i < n; i++)
     {
-        const int step = 512;
-        long idcnt[256] = {0};
+        QTreeWidgetItem *item = tree->topLevelItem(i);
+        if (item->text(0) == name && item->data(0, Qt::UserRole).isNull())
+            return item;
+    }
+    QTreeWidgetItem *item = new QTreeWidgetItem(tree);
+    item->setText(0, name);
+    return item;
+}
 
-        for (int x = x1; x <= x2; x += step)
-        {
-            for (int z = z1; z <= z2; z += step)
-            {
-                int w = x2-x+1 < step ? x2-x+1 : step;
-                int h = z2-z+1 < step ? z2-z+1 : step;
-                Range r = {1, x, z, w, h, wi.y, 1};
-                int *ids = allocCache(&g, r);
-
-                int dims[] = {0, -1, +1};
-                for (int d = 0; d < 3; d++)
-                {
-                    if (dims[d] == dim || !map_only)
-                    {
-                        applySeed(&g, dims[d], wi.seed);
-                        genBiomes(&g, ids, r);
-                        for (int i = 0; i < w*h; i++)
-                            idcnt[ ids[i] & 0xff ]++;
-                    }
-                }
-                free(ids);
-            }
-        }
+void MainWindow::onAnalysisProgress(int done, int total)
+{
+    ui->progressAnalysis->setMaximum(total > 0 ? total : 1);
+    ui->progressAnalysis->setValue(done);
+    ui->progressAnalysis->setFormat(QString::asprintf("%d / %d", done, total));
+}
 
-        int bcnt = 0;
-        for (int i = 0; i < 256; i++)
-            bcnt += !!idcnt[i];
+QTreeWidgetItem *MainWindow::getAnalysisBiome(QTreeWidgetItem *item_cat, int id)
+{
+    const char *s = biome2str(analysis.ac.wi.mc, id);
+    if (!s)
+        return NULL;
+    for (int i = 0, n = item_cat->childCount(); i < n; i++)
+    {
+        if (item_cat->child(i)->type() == QTreeWidgetItem::UserType + id)
+            return item_cat->child(i);
+    }
+    QTreeWidgetItem *item = new QTreeWidgetItem(item_cat, QTreeWidgetItem::UserType + id);
+    item->setText(0, s);
+    return item;
+}
 
-        QTreeWidgetItem* item_cat = new QTreeWidgetItem(tree);
-        item_cat->setText(0, "biomes");
-        item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(bcnt));
+void MainWindow::onAnalysisBiomes(QVector<qint64> idcnt)
+{
+    QTreeWidgetItem *item_cat = getAnalysisCategory("biomes");
 
-        for (int id = 0; id < 256; id++)
-        {
-            long cnt = idcnt[id];
-            if (cnt <= 0)
-                continue;
-            const char *s;
-            if (!(s = biome2str(wi.mc, id)))
-                continue;
-            QTreeWidgetItem* item =
-                new QTreeWidgetItem(item_cat, QTreeWidgetItem::UserType + id);
-            item->setText(0, s);
+    int bcnt = 0;
+    for (int id = 0; id < 256; id++)
+    {
+        qint64 cnt = idcnt[id];
+        if (cnt <= 0)
+            continue;
+        bcnt++;
+        QTreeWidgetItem *item = getAnalysisBiome(item_cat, id);
+        if (item)
             item->setData(1, Qt::DisplayRole, QVariant::fromValue(cnt));
-        }
     }
+    item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(bcnt));
+}
 
-    if (ck_struct)
+void MainWindow::onAnalysisSampled(QVector<double> frac, QVector<double> ci95)
+{
+    QTreeWidgetItem *item_cat = getAnalysisCategory("biomes");
+
+    int bcnt = 0;
+    for (int id = 0; id < 256; id++)
     {
-        std::vector<VarPos> st;
-        for (int sopt = D_DESERT; sopt < D_SPAWN; sopt++)
-        {
-            int sdim = 0;
-            if (sopt == D_FORTESS || sopt == D_BASTION || sopt == D_PORTALN)
-                sdim = -1;
-            if (sopt == D_ENDCITY || sopt == D_GATEWAY)
-                sdim = 1;
-            if (map_only)
-            {
-                if (!getMapView()->getShow(sopt))
-                    continue;
-                if (sdim != dim)
-                    continue;
-            }
-            int stype = mapopt2stype(sopt);
-            st.clear();
-            StructureConfig sconf;
-            if (!getStructureConfig_override(stype, wi.mc, &sconf))
-                continue;
-            getStructs(&st, sconf, wi, sdim, x1, z1, x2, z2);
-            if (st.empty())
-                continue;
-
-            QTreeWidgetItem* item_cat = new QTreeWidgetItem(tree);
-            const char *s = struct2str(stype);
-            item_cat->setText(0, s);
-            item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(st.size()));
-
-            for (size_t i = 0; i < st.size(); i++)
-            {
-                VarPos vp = st[i];
-                QTreeWidgetItem* item = new QTreeWidgetItem(item_cat);
-                item->setData(0, Qt::UserRole, QVariant::fromValue(vp.p));
-                item->setText(0, QString::asprintf("%d,\t%d", vp.p.x, vp.p.z));
-                if (vp.variant)
-                {
-                    if (stype == Village)
-                        item->setText(1, "abandoned");
-                }
-            }
-        }
+        if (frac[id] <= 0)
+            continue;
+        bcnt++;
+        QTreeWidgetItem *item = getAnalysisBiome(item_cat, id);
+        if (item)
+            item->setText(1, QString::asprintf("%.2f%% ± %.2f%%", 100 * frac[id], 100 * ci95[id]));
+    }
+    item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(bcnt));
+}
 
-        if ((dim == 0 && getMapView()->getShow(D_SPAWN)) || !map_only)
-        {
-            applySeed(&g, 0, wi.seed);
-            Pos pos = getSpawn(&g);
-            if (pos.x >= x1 && pos.x <= x2 && pos.z >= z1 && pos.z <= z2)
-            {
-                QTreeWidgetItem* item_cat = new QTreeWidgetItem(tree);
-                item_cat->setText(0, "spawn");
-                item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(1));
-                QTreeWidgetItem* item = new QTreeWidgetItem(item_cat);
-                item->setData(0, Qt::UserRole, QVariant::fromValue(pos));
-                item->setText(0, QString::asprintf("%d,\t%d", pos.x, pos.z));
-            }
-        }
+static QString analysisStructName(int sopt)
+{
+    if (sopt == D_SPAWN)
+        return "spawn";
+    if (sopt == D_STRONGHOLD)
+        return "stronghold";
+    return struct2str(mapopt2stype(sopt));
+}
 
-        if ((dim == 0 && getMapView()->getShow(D_STRONGHOLD)) || !map_only)
+void MainWindow::onAnalysisStructs(int sopt, QVector<StructLoc> locs)
+{
+    int stype = mapopt2stype(sopt);
+    QTreeWidgetItem *item_cat = getAnalysisCategory(analysisStructName(sopt));
+    for (const StructLoc& sl : locs)
+    {
+        QTreeWidgetItem* item = new QTreeWidgetItem(item_cat);
+        item->setData(0, Qt::UserRole, QVariant::fromValue(sl.p));
+        item->setText(0, QString::asprintf("%d,\t%d", sl.p.x, sl.p.z));
+        if (sl.variant)
         {
-            StrongholdIter sh;
-            initFirstStronghold(&sh, wi.mc, wi.seed);
-            std::vector<Pos> shp;
-            applySeed(&g, dim, wi.seed);
-            while (nextStronghold(&sh, &g) > 0)
-            {
-                Pos pos = sh.pos;
-                if (pos.x >= x1 && pos.x <= x2 && pos.z >= z1 && pos.z <= z2)
-                    shp.push_back(pos);
-            }
-
-            if (!shp.empty())
-            {
-                QTreeWidgetItem* item_cat = new QTreeWidgetItem(tree);
-                item_cat->setText(0, "stronghold");
-                item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(shp.size()));
-                for (Pos pos : shp)
-                {
-                    QTreeWidgetItem* item = new QTreeWidgetItem(item_cat);
-                    item->setData(0, Qt::UserRole, QVariant::fromValue(pos));
-                    item->setText(0, QString::asprintf("%d,\t%d", pos.x, pos.z));
-                }
-            }
+            if (stype == Village)
+                item->setText(1, "abandoned");
         }
     }
+    item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(item_cat->childCount()));
+}
 
-    QElapsedTimer timer;
-    timer.start();
-    int64_t warn_ms = 1000;
-
-    if (ck_conds && !conds.empty())
+void MainWindow::onAnalysisStreamed(int sopt, qint64 total, QVector<StructLoc> sample)
+{
+    QTreeWidgetItem *item_cat = getAnalysisCategory(analysisStructName(sopt));
+    int stype = mapopt2stype(sopt);
+    for (const StructLoc& sl : sample)
     {
-        WorldGen gen;
-        Pos cpos[100];
-        gen.init(wi.mc, wi.large);
-        gen.setSeed(wi.seed);
+        QTreeWidgetItem* item = new QTreeWidgetItem(item_cat);
+        item->setData(0, Qt::UserRole, QVariant::fromValue(sl.p));
+        item->setText(0, QString::asprintf("%d,\t%d", sl.p.x, sl.p.z));
+        if (sl.variant && stype == Village)
+            item->setText(1, "abandoned");
+    }
+    // the notices of the workers may arrive out of order
+    qint64 cnt = item_cat->data(1, Qt::DisplayRole).toLongLong();
+    if (total > cnt)
+        item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(total));
+}
 
-        //Condition& c0 = conds[0];
-        int xr1 = 0; //(int)( cstepx * floor( (x1+c0.x1) / (double)cstepx ) );
-        int zr1 = 0; //(int)( cstepz * floor( (z1+c0.z1) / (double)cstepz ) );
-        int xr2 = 0; //(int)( cstepx * ceil( (x2+c0.x2) / (double)cstepx ) );
-        int zr2 = 0; //(int)( cstepz * ceil( (z2+c0.z2) / (double)cstepz ) );
+void MainWindow::onAnalysisConds(QVector<CondLoc> locs)
+{
+    QVector<Condition> conds = analysis.ac.condvec;
+    QList<QTreeWidgetItem*> items;
 
-        QList<QTreeWidgetItem*> items;
+    for (const CondLoc& cl : locs)
+    {
+        QTreeWidgetItem* loc = new QTreeWidgetItem();
+        loc->setData(0, Qt::UserRole, QVariant::fromValue(cl.origin));
+        loc->setText(0, QString::asprintf(
+            "condition @[%d, %d]", cl.origin.x, cl.origin.z));
 
-        for (int x = xr1; x <= xr2; x += cstepx)
+        for (int i = 0; i < conds.size() && i < cl.cpos.size(); i++)
         {
-            //if (x + c0.x1 > x2 || x + c0.x2 < x1)
-            //    continue;
-            for (int z = zr1; z <= zr2; z += cstepz)
-            {
-                //if (z + c0.z1 > z2 || z + c0.z2 < z1)
-                //    continue;
-
-                if (timer.elapsed() > warn_ms)
-                {
-                    int button = QMessageBox::warning(
-                        this, "Warning",
-                        QString::asprintf(
-                            "The search is taking some time.\n"
-                            "Locations found so far: %d\n"
-                            "Continue search?", items.size()),
-                        QMessageBox::Abort, QMessageBox::Yes);
-                    if (button != QMessageBox::Yes)
-                        goto L_scan_end;
-                    update();
-                    QApplication::processEvents();
-                    warn_ms *= 4;
-                    timer.start();
-                }
-
-                Pos origin = {x, z};
-                std::atomic_bool ab;
-                ab = false;
-                if (testSeedAt(origin, cpos, &conds, PASS_FULL_64, &gen, &ab)
-                    != COND_OK)
-                {
-                    continue;
-                }
-                //Pos p = cpos[conds[0].save];
-                //if (p.x < x1 || p.x > x2 || p.z < z1 || p.z > z2)
-                //    continue;
-
-                QTreeWidgetItem* loc = new QTreeWidgetItem();
-                loc->setData(0, Qt::UserRole, QVariant::fromValue(origin));
-                loc->setText(0, QString::asprintf(
-                    "condition @[%d, %d]", origin.x, origin.z));
-
-                for (int i = 0; i < conds.size(); i++)
-                {
-                    Pos p = cpos[conds[i].save];
-                    QTreeWidgetItem* item = new QTreeWidgetItem(loc);
-                    item->setText(0, cond2str(&conds[i]));
-                    item->setData(0, Qt::UserRole, QVariant::fromValue(p));
-                    item->setText(1, QString::asprintf("%d,\t%d", p.x, p.z));
-                }
-
-                items.push_back(loc);
-
-                if (items.size() >= 65536)
-                {
-                    QMessageBox::warning(
-                        this, "警告",
-                        QString::asprintf(
-                            "即将超过最大允许结果数 (%d).\n"
-                            "停止搜索", items.size()),
-                        QMessageBox::Ok);
-                    goto L_scan_end;
-                }
-            }
+            Pos p = cl.cpos[i];
+            QTreeWidgetItem* item = new QTreeWidgetItem(loc);
+            item->setText(0, cond2str(&conds[i]));
+            item->setData(0, Qt::UserRole, QVariant::fromValue(p));
+            item->setText(1, QString::asprintf("%d,\t%d", p.x, p.z));
         }
-L_scan_end:
 
-        if (!items.empty())
-        {
-            /*
-            QTreeWidgetItem* item_cat = new QTreeWidgetItem(tree);
-            item_cat->setText(0, "conditions");
-            item_cat->setData(1, Qt::DisplayRole, QVariant::fromValue(items.size()));
-            item_cat->addChildren(items);
-            */
-            tree->addTopLevelItems(items);
-        }
+        items.push_back(loc);
     }
 
+    ui->treeAnalysis->addTopLevelItems(items);
+}
+
+void MainWindow::onAnalysisLimit(int cnt)
+{
+    QMessageBox::warning(
+        this, "警告",
+        QString::asprintf(
+            "即将超过最大允许结果数 (%d).\n"
+            "停止搜索", cnt),
+        QMessageBox::Ok);
+}
+
+void MainWindow::onAnalysisFinished()
+{
+    if (analysis.isRunning())
+        return; // notice of a previous run
+    ui->buttonAnalysis->setText("开始分析");
     ui->buttonExport->setEnabled(true);
-    ui->buttonAnalysis->setEnabled(true);
+    if (analysis.abort)
+        ui->progressAnalysis->setFormat("已取消");
+    else
+        ui->progressAnalysis->setFormat("完成");
+    if (analysis.exporterr)
+    {
+        analysis.exporterr = false;
+        warning("警告", "写入文件失败");
+    }
 }
 
 void MainWindow::on_buttonExport_clicked()
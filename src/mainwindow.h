@@ -14,6 +14,7 @@
 #include <QRunnable>
 #include <QMutex>
 #include <QVector>
+#include <QSettings>
 
 #include <atomic>
 
@@ -22,6 +23,7 @@
 #include "formconditions.h"
 #include "formgen48.h"
 #include "formsearchcontrol.h"
+#include "analysis.h"
 
 namespace Ui {
 class MainWindow;
@@ -50,6 +52,11 @@ public:
     int getDim();
     MapView *getMapView();
 
+    // settings that affect the generation and the colors, which are shared
+    // with the headless export
+    static void loadExtGen(QSettings *settings);
+    static void loadBiomeColors(QString path);
+
 protected:
     void saveSettings();
     void loadSettings();
@@ -78,6 +85,9 @@ private slots:
     void on_actionGo_to_triggered();
     void on_actionScan_seed_for_Quad_Huts_triggered();
     void on_actionOpen_shadow_seed_triggered();
+    void on_actionExport_map_image_triggered();
+    void on_actionRender_stats_toggled(bool checked);
+    void on_actionExport_render_trace_triggered();
     void on_actionAbout_triggered();
     void on_actionCopy_triggered();
     void on_actionPaste_triggered();
@@ -108,6 +118,19 @@ private slots:
     void copyCoord();
     void copyTeleportCommand();
 
+    void onAnalysisProgress(int done, int total);
+    void onAnalysisBiomes(QVector<qint64> idcnt);
+    void onAnalysisSampled(QVector<double> frac, QVector<double> ci95);
+    void onAnalysisStructs(int sopt, QVector<StructLoc> locs);
+    void onAnalysisStreamed(int sopt, qint64 total, QVector<StructLoc> sample);
+    void onAnalysisConds(QVector<CondLoc> locs);
+    void onAnalysisLimit(int cnt);
+    void onAnalysisFinished();
+
+private:
+    QTreeWidgetItem *getAnalysisCategory(QString name);
+    QTreeWidgetItem *getAnalysisBiome(QTreeWidgetItem *item_cat, int id);
+
 
 public:
     Ui::MainWindow *ui;
@@ -123,6 +146,7 @@ public:
     QActionGroup *dimgroup;
 
     ProtoBaseDialog *protodialog;
+    AnalysisThread analysis;
 };
 
 #endif // MAINWINDOW_H
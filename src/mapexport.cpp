@@ -0,0 +1,358 @@
+#include "mapexport.h"
+
+#include "tilecache.h"
+#include "cutil.h"
+
+#include <QFile>
+#include <QImage>
+#include <QThreadPool>
+#include <QtEndian>
+
+#include <vector>
+#include <utility>
+
+
+// BigTIFF field types
+enum { TIFF_SHORT = 3, TIFF_LONG = 4, TIFF_LONG8 = 16 };
+
+static inline int floordiv(int a, int b)
+{
+    return a >= 0 ? a / b : -1 - (-1 - a) / b;
+}
+
+/* Minimal little endian BigTIFF writer for 8-bit RGB images, with the
+ * rows appended one at a time as deflate compressed strips. The directory
+ * follows the image data and is linked from the header when finished.
+ */
+struct TiffWriter
+{
+    QFile file;
+    quint32 width, height;
+    std::vector<quint64> offsets;
+    std::vector<quint64> counts;
+    bool ok;
+
+    TiffWriter(QString path) : file(path),width(),height(),offsets(),counts(),ok() {}
+
+    void put(const void *data, qint64 n)
+    {
+        if (ok && file.write((const char*) data, n) != n)
+            ok = false;
+    }
+    void put16(quint16 v) { uchar b[2]; qToLittleEndian(v, b); put(b, 2); }
+    void put64(quint64 v) { uchar b[8]; qToLittleEndian(v, b); put(b, 8); }
+
+    bool open(quint32 w, quint32 h)
+    {
+        width = w;
+        height = h;
+        ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        put("II", 2);
+        put16(43);      // BigTIFF
+        put16(8);       // offset size
+        put16(0);
+        put64(0);       // first directory, set when finished
+        return ok;
+    }
+
+    bool writeRow(const uchar *rgb)
+    {
+        // qCompress yields a zlib stream behind a 4-byte length prefix
+        QByteArray z = qCompress(rgb, width * 3);
+        offsets.push_back(file.pos());
+        counts.push_back(z.size() - 4);
+        put(z.constData() + 4, z.size() - 4);
+        return ok;
+    }
+
+    void entry(quint16 tag, quint16 type, quint64 count, quint64 value)
+    {
+        put16(tag);
+        put16(type);
+        put64(count);
+        put64(value);
+    }
+
+    bool finish()
+    {
+        if (!ok || offsets.size() != height)
+            return false;
+
+        // the directory and arrays start on a word boundary
+        if (file.pos() & 1)
+            put("", 1);
+
+        // strip arrays that do not fit into the directory entries
+        quint64 offpos = offsets[0], cntpos = counts[0];
+        if (height > 1)
+        {
+            offpos = file.pos();
+            for (quint64 v : offsets)
+                put64(v);
+            cntpos = file.pos();
+            for (quint64 v : counts)
+                put64(v);
+        }
+
+        quint64 ifdpos = file.pos();
+        put64(10);
+        entry(256, TIFF_LONG,  1, width);           // ImageWidth
+        entry(257, TIFF_LONG,  1, height);          // ImageLength
+        entry(258, TIFF_SHORT, 3, 8 | (8ULL << 16) | (8ULL << 32)); // BitsPerSample
+        entry(259, TIFF_SHORT, 1, 8);               // Compression: deflate
+        entry(262, TIFF_SHORT, 1, 2);               // PhotometricInterpretation: RGB
+        entry(273, TIFF_LONG8, height, offpos);     // StripOffsets
+        entry(277, TIFF_SHORT, 1, 3);               // SamplesPerPixel
+        entry(278, TIFF_LONG,  1, 1);               // RowsPerStrip
+        entry(279, TIFF_LONG8, height, cntpos);     // StripByteCounts
+        entry(284, TIFF_SHORT, 1, 1);               // PlanarConfiguration: chunky
+        put64(0);
+
+        if (ok && !file.seek(8))
+            ok = false;
+        put64(ifdpos);
+        file.close();
+        return ok;
+    }
+};
+
+
+// generates a biome tile of the map and colors its part of the band
+struct ExportTile : public QRunnable
+{
+    const MapExportConfig *ec;
+    const Generator *g;
+    const QRgb *colors;
+    int pixs, ti, tj;
+    int cx0, cz0;       // image origin in cells
+    int r0, bh;         // rows of the band in cells
+    int w;
+    QRgb *band;
+    std::atomic_bool *abort;
+
+    void run()
+    {
+        if (*abort)
+            return;
+        int s = ec->scale;
+        int y = (s > 1) ? ec->wi.y >> 2 : ec->wi.y;
+        TileKey key = { ec->wi.mc, mapGenFlags(ec->wi), ec->wi.seed, ec->dim, y, s, pixs, ti, tj };
+        Range r = {s, ti*pixs, tj*pixs, pixs, pixs, y, 1};
+        int *ids = allocCache(g, r);
+        // the cache is only read: an export can cover far more tiles than the
+        // cache holds, which would queue them all for writing and evict the
+        // tiles of the map
+        if (!g_tilecache.load(key, ids, pixs*pixs) && genBiomes(g, ids, r))
+        {
+            for (int i = 0; i < pixs*pixs; i++)
+                ids[i] = -1;
+        }
+
+        int c0 = std::max(r.x, cx0), c1 = std::min(r.x + pixs, cx0 + w);
+        for (int row = r0; row < r0 + bh; row++)
+        {
+            const int *src = ids + (qint64)(row - r.z) * pixs;
+            QRgb *dst = band + (qint64)(row - r0) * w - cx0;
+            for (int c = c0; c < c1; c++)
+            {
+                int id = src[c - r.x];
+                dst[c] = colors[(id >= 0 && id < TILE_NONE) ? id : TILE_NONE];
+            }
+        }
+        free(ids);
+    }
+};
+
+// draws a (premultiplied) icon centered at a pixel of the band
+static void blendIcon(QRgb *band, int w, int bh, qint64 px, qint64 py, const QImage& icon)
+{
+    int iw = icon.width(), ih = icon.height();
+    px -= iw / 2;
+    py -= ih / 2;
+    for (int j = 0; j < ih; j++)
+    {
+        qint64 y = py + j;
+        if (y < 0 || y >= bh)
+            continue;
+        const QRgb *src = (const QRgb*) icon.constScanLine(j);
+        QRgb *dst = band + y * w;
+        for (int i = 0; i < iw; i++)
+        {
+            qint64 x = px + i;
+            int a = qAlpha(src[i]);
+            if (x < 0 || x >= w || a == 0)
+                continue;
+            QRgb d = dst[x];
+            dst[x] = qRgb(
+                qRed(src[i])   + qRed(d)   * (255 - a) / 255,
+                qGreen(src[i]) + qGreen(d) * (255 - a) / 255,
+                qBlue(src[i])  + qBlue(d)  * (255 - a) / 255);
+        }
+    }
+}
+
+bool exportMapImage(const MapExportConfig& ec, std::atomic_bool *abort,
+        std::function<void(int,int)> progress, QString *err)
+{
+    int s = ec.scale;
+    if (s != 1 && s != 4 && s != 16 && s != 64 && !(s == 256 && ec.dim == 0))
+    {
+        *err = "不支持该比例";
+        return false;
+    }
+    int cx0 = floordiv(ec.x0, s), cz0 = floordiv(ec.z0, s);
+    int cx1 = floordiv(ec.x1, s), cz1 = floordiv(ec.z1, s);
+    qint64 w = (qint64)cx1 - cx0 + 1, h = (qint64)cz1 - cz0 + 1;
+    if (w <= 0 || h <= 0 || w > (1 << 28) || h > (1 << 28))
+    {
+        *err = "无法导出该区域";
+        return false;
+    }
+
+    int pixs = mapTilePixels(ec.wi.mc);
+    // the biomes are the tiles of the map (and read from the tile cache when
+    // available), while the structures are placed with the flags of the game,
+    // as in the map view
+    Generator g;
+    setupGenerator(&g, ec.wi.mc, mapGenFlags(ec.wi));
+    applySeed(&g, ec.dim, ec.wi.seed);
+    Generator sg;
+    setupGenerator(&sg, ec.wi.mc, ec.wi.large);
+    applySeed(&sg, ec.dim, ec.wi.seed);
+    SurfaceNoise sne;
+    initSurfaceNoiseEnd(&sne, ec.wi.seed);
+
+    QRgb colors[256];
+    for (int i = 0; i < 256; i++)
+        colors[i] = qRgb(biomeColors[i][0], biomeColors[i][1], biomeColors[i][2]);
+    colors[TILE_NONE] = qRgb(0, 0, 0);
+
+    QImage icons[STRUCT_NUM];
+    for (int sopt = D_DESERT; sopt < STRUCT_NUM; sopt++)
+    {
+        if (!ec.show[sopt])
+            continue;
+        const char *name = sopt == D_PORTALN ? "portal" : mapopt2str(sopt);
+        icons[sopt] = QImage(QString(":/icons/") + name + ".png")
+            .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+    int pad = 0; // icon radius in pixels
+    for (int sopt = D_DESERT; sopt < STRUCT_NUM; sopt++)
+        pad = std::max(pad, std::max(icons[sopt].width(), icons[sopt].height()) / 2 + 1);
+
+    // non-recurring structures are located once (with their map option)
+    std::vector<std::pair<Pos, int>> unique;
+    if (ec.dim == 0 && ec.show[D_SPAWN])
+        unique.push_back(std::make_pair(getSpawn(&sg), (int)D_SPAWN));
+    if (ec.dim == 0 && ec.show[D_STRONGHOLD])
+    {
+        StrongholdIter sh;
+        initFirstStronghold(&sh, ec.wi.mc, ec.wi.seed);
+        while (!*abort && nextStronghold(&sh, &sg) > 0)
+            unique.push_back(std::make_pair(sh.pos, (int)D_STRONGHOLD));
+    }
+
+    TiffWriter tw(ec.path);
+    if (!tw.open(w, h))
+    {
+        *err = "打开文件失败";
+        return false;
+    }
+
+    std::vector<QRgb> band((size_t)w * pixs);
+    std::vector<uchar> rgb((size_t)w * 3);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+
+    int ti0 = floordiv(cx0, pixs), ti1 = floordiv(cx1, pixs);
+    int tj0 = floordiv(cz0, pixs), tj1 = floordiv(cz1, pixs);
+    for (int tj = tj0; tj <= tj1 && !*abort; tj++)
+    {
+        int r0 = std::max(tj * pixs, cz0);
+        int r1 = std::min(tj * pixs + pixs - 1, cz1);
+        int bh = r1 - r0 + 1;
+
+        for (int ti = ti0; ti <= ti1; ti++)
+        {
+            ExportTile *t = new ExportTile();
+            t->ec = &ec;
+            t->g = &g;
+            t->colors = colors;
+            t->pixs = pixs;
+            t->ti = ti;
+            t->tj = tj;
+            t->cx0 = cx0;
+            t->cz0 = cz0;
+            t->r0 = r0;
+            t->bh = bh;
+            t->w = w;
+            t->band = band.data();
+            t->abort = abort;
+            pool.start(t);
+        }
+        pool.waitForDone();
+        if (*abort)
+            break;
+
+        // structures with icons that reach into the band
+        int bx0 = (cx0 - pad) * s, bx1 = (cx1 + 1 + pad) * s;
+        int bz0 = (r0 - pad) * s, bz1 = (r1 + 1 + pad) * s;
+        for (int sopt = D_DESERT; sopt < D_SPAWN; sopt++)
+        {
+            if (!ec.show[sopt] || mapopt2dim(sopt) != ec.dim)
+                continue;
+            StructureConfig sconf;
+            if (!getStructureConfig_override(mapopt2stype(sopt), ec.wi.mc, &sconf))
+                continue;
+            std::vector<VarPos> st;
+            getStructs(&st, sconf, ec.wi, &sg, &sne, bx0, bz0, bx1, bz1);
+            for (const VarPos& vp : st)
+            {
+                blendIcon(band.data(), w, bh,
+                    floordiv(vp.p.x, s) - cx0, floordiv(vp.p.z, s) - r0, icons[sopt]);
+            }
+        }
+        for (const auto& u : unique)
+        {
+            blendIcon(band.data(), w, bh,
+                floordiv(u.first.x, s) - cx0, floordiv(u.first.z, s) - r0, icons[u.second]);
+        }
+
+        for (int j = 0; j < bh; j++)
+        {
+            const QRgb *src = band.data() + (size_t)j * w;
+            for (qint64 i = 0; i < w; i++)
+            {
+                rgb[3*i+0] = qRed(src[i]);
+                rgb[3*i+1] = qGreen(src[i]);
+                rgb[3*i+2] = qBlue(src[i]);
+            }
+            if (!tw.writeRow(rgb.data()))
+                break;
+        }
+        if (!tw.ok)
+            break;
+
+        if (progress)
+            progress(tj - tj0 + 1, tj1 - tj0 + 1);
+    }
+
+    if (*abort || !tw.finish())
+    {
+        if (!*abort)
+            *err = "写入文件失败";
+        tw.file.close();
+        tw.file.remove();
+        return false;
+    }
+    return true;
+}
+
+
+void MapExportThread::run()
+{
+    ok = exportMapImage(ec, &abort, [this](int done, int total) {
+        emit progress(done, total);
+    }, &err);
+}
@@ -0,0 +1,58 @@
+#ifndef MAPEXPORT_H
+#define MAPEXPORT_H
+
+#include "settings.h"
+#include "quad.h"
+
+#include <QThread>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+
+
+struct MapExportConfig
+{
+    WorldInfo wi;
+    int dim;
+    int scale;              // blocks per pixel (1, 4, 16, 64, or 256 in the overworld)
+    int x0, z0, x1, z1;     // area in blocks (inclusive)
+    bool show[STRUCT_NUM];  // structure options to draw
+    QString path;           // output image (BigTIFF)
+};
+
+/* Renders an area of the map into an image file, one band of biome tiles at
+ * a time. The tiles of a band are the same as those of the map (and are
+ * read from the tile cache if the map already generated them, but are not
+ * added to it); they are generated in parallel, overlaid with the structure
+ * icons, and the band is compressed and appended to the file before the next
+ * one is started. Memory is therefore bounded by one band,
+ * regardless of the image size.
+ *
+ * The image is written as a BigTIFF with one deflate compressed strip per
+ * row, since a PNG cannot be streamed without an incremental deflate encoder.
+ * Returns false on failure or abort, with a message in err.
+ */
+bool exportMapImage(const MapExportConfig& ec, std::atomic_bool *abort,
+        std::function<void(int,int)> progress, QString *err);
+
+// runs the map export in the background
+struct MapExportThread : public QThread
+{
+    Q_OBJECT
+public:
+    MapExportThread(const MapExportConfig& ec) : ec(ec),abort(),ok() {}
+
+    virtual void run() override;
+
+signals:
+    void progress(int done, int total);
+
+public:
+    MapExportConfig ec;
+    std::atomic_bool abort;
+    bool ok;
+    QString err;
+};
+
+#endif // MAPEXPORT_H
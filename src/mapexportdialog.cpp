@@ -0,0 +1,121 @@
+#include "mapexportdialog.h"
+#include "ui_mapexportdialog.h"
+
+#include "mainwindow.h"
+#include "mapview.h"
+
+#include <QIntValidator>
+#include <QFileDialog>
+#include <QMessageBox>
+
+
+MapExportDialog::MapExportDialog(MainWindow *parent)
+    : QDialog(parent)
+    , ui(new Ui::MapExportDialog)
+    , mainwindow(parent)
+    , thread()
+{
+    ui->setupUi(this);
+
+    QIntValidator *intval = new QIntValidator(-30000000, 30000000, this);
+    ui->lineX1->setValidator(intval);
+    ui->lineZ1->setValidator(intval);
+    ui->lineX2->setValidator(intval);
+    ui->lineZ2->setValidator(intval);
+
+    // default to the visible area of the map
+    MapView *mapview = mainwindow->getMapView();
+    qreal x = mapview->getX(), z = mapview->getZ(), scale = mapview->getScale();
+    int hw = (int)(mapview->width() * scale / 2), hh = (int)(mapview->height() * scale / 2);
+    ui->lineX1->setText(QString::number((int)x - hw));
+    ui->lineZ1->setText(QString::number((int)z - hh));
+    ui->lineX2->setText(QString::number((int)x + hw));
+    ui->lineZ2->setText(QString::number((int)z + hh));
+
+    ui->progressBar->setVisible(false);
+}
+
+MapExportDialog::~MapExportDialog()
+{
+    stopExport();
+    delete ui;
+}
+
+void MapExportDialog::stopExport()
+{
+    if (thread)
+    {
+        thread->abort = true;
+        thread->wait();
+        delete thread;
+        thread = NULL;
+    }
+}
+
+void MapExportDialog::onProgress(int done, int total)
+{
+    ui->progressBar->setMaximum(total > 0 ? total : 1);
+    ui->progressBar->setValue(done);
+}
+
+void MapExportDialog::onFinished()
+{
+    if (!thread)
+        return;
+    bool ok = thread->ok, aborted = thread->abort;
+    QString err = thread->err;
+    stopExport();
+    ui->buttonExport->setText("导出...");
+    ui->progressBar->setVisible(false);
+    if (!ok && !aborted)
+        QMessageBox::warning(this, "警告", err);
+}
+
+void MapExportDialog::on_buttonExport_clicked()
+{
+    if (thread)
+    {
+        thread->abort = true;
+        return;
+    }
+
+    MapExportConfig ec;
+    mainwindow->getSeed(&ec.wi);
+    ec.dim = mainwindow->getDim();
+    ec.scale = 1 << (2 * ui->comboScale->currentIndex());
+    ec.x0 = ui->lineX1->text().toInt();
+    ec.z0 = ui->lineZ1->text().toInt();
+    ec.x1 = ui->lineX2->text().toInt();
+    ec.z1 = ui->lineZ2->text().toInt();
+    for (int sopt = 0; sopt < STRUCT_NUM; sopt++)
+        ec.show[sopt] = ui->checkStructs->isChecked() && mainwindow->getMapView()->getShow(sopt);
+
+    if (ec.x1 < ec.x0 || ec.z1 < ec.z0)
+    {
+        QMessageBox::warning(this, "警告", "无法导出该区域");
+        return;
+    }
+    if (ec.scale == 256 && ec.dim != 0)
+    {
+        QMessageBox::warning(this, "警告", "该维度不支持 1:256 比例");
+        return;
+    }
+
+    ec.path = QFileDialog::getSaveFileName(this, "导出地图图像", mainwindow->prevdir,
+        "TIFF images (*.tif *.tiff);;Any files (*)");
+    if (ec.path.isEmpty())
+        return;
+
+    thread = new MapExportThread(ec);
+    connect(thread, &MapExportThread::progress, this, &MapExportDialog::onProgress, Qt::QueuedConnection);
+    connect(thread, &QThread::finished, this, &MapExportDialog::onFinished, Qt::QueuedConnection);
+    ui->buttonExport->setText("取消");
+    ui->progressBar->setValue(0);
+    ui->progressBar->setVisible(true);
+    thread->start();
+}
+
+void MapExportDialog::on_buttonClose_clicked()
+{
+    close();
+}
@@ -0,0 +1,36 @@
+#ifndef MAPEXPORTDIALOG_H
+#define MAPEXPORTDIALOG_H
+
+#include "mapexport.h"
+
+#include <QDialog>
+
+namespace Ui {
+class MapExportDialog;
+}
+class MainWindow;
+
+class MapExportDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit MapExportDialog(MainWindow *parent);
+    ~MapExportDialog();
+
+private slots:
+    void onProgress(int done, int total);
+    void onFinished();
+
+    void on_buttonExport_clicked();
+    void on_buttonClose_clicked();
+
+private:
+    void stopExport();
+
+    Ui::MapExportDialog *ui;
+    MainWindow *mainwindow;
+    MapExportThread *thread;
+};
+
+#endif // MAPEXPORTDIALOG_H
@@ -0,0 +1,291 @@
+#include "maptrace.h"
+
+#include "quad.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <cstring>
+
+
+// bounds the memory of the recording to a few tens of MB
+#define TRACE_EVENTS    (1 << 18)
+#define TRACE_COUNTERS  (1 << 16)
+
+MapTrace g_maptrace;
+
+static const char *phasenames[TR_PHASE_NUM] = {
+    "fill", "biomes", "overlays", "structs", "update"
+};
+
+static int scaleIndex(int scale)
+{
+    int i = 0;
+    while (scale > 1 && i < 4)
+    {
+        scale >>= 2;
+        i++;
+    }
+    return i;
+}
+
+
+MapTrace::MapTrace()
+    : enabled()
+    , timer()
+    , mutex()
+    , events()
+    , next()
+    , wrapped()
+    , counters()
+    , tids()
+    , biomes()
+    , previews()
+    , structs(STRUCT_NUM)
+    , frames()
+    , curphase()
+    , lastframe()
+    , nframes()
+    , lastcnt()
+{
+    timer.start();
+}
+
+void MapTrace::setEnabled(bool on)
+{
+    QMutexLocker locker(&mutex);
+    if (on && !enabled)
+    {
+        events.clear();
+        events.reserve(TRACE_EVENTS);
+        next = 0;
+        wrapped = false;
+        counters.clear();
+        tids.clear();
+        memset(biomes, 0, sizeof(biomes));
+        memset(previews, 0, sizeof(previews));
+        std::fill(structs.begin(), structs.end(), TileStat());
+        memset(frames, 0, sizeof(frames));
+        memset(curphase, 0, sizeof(curphase));
+        lastframe = 0;
+        nframes = 0;
+        lastcnt = MapCounters();
+        timer.restart();
+        threadId(); // the GUI thread comes first
+    }
+    enabled = on;
+}
+
+int MapTrace::threadId()
+{
+    // called with a locked mutex
+    quintptr key = (quintptr) QThread::currentThreadId();
+    auto it = tids.find(key);
+    if (it == tids.end())
+        it = tids.insert(key, tids.size());
+    return it.value();
+}
+
+void MapTrace::record(const Event& e)
+{
+    // called with a locked mutex
+    if (events.size() < TRACE_EVENTS)
+    {
+        events.push_back(e);
+        return;
+    }
+    events[next] = e;
+    next = (next + 1) % TRACE_EVENTS;
+    wrapped = true;
+}
+
+qint64 MapTrace::phase(int ph, qint64 t0)
+{
+    if (!enabled)
+        return 0;
+    qint64 t1 = now();
+    if (t0 <= 0 || t1 < t0)
+        return t1; // the trace was (re)started during the frame
+
+    QMutexLocker locker(&mutex);
+    Event e = { phasenames[ph], "draw", t0, t1 - t0, threadId(), -1, {} };
+    record(e);
+    curphase[ph] += t1 - t0;
+    return t1;
+}
+
+void MapTrace::frame(qint64 t0, const MapCounters& c)
+{
+    if (!enabled)
+        return;
+    qint64 t1 = now();
+    if (t0 <= 0 || t1 < t0)
+        return;
+
+    QMutexLocker locker(&mutex);
+    Event e = { "frame", "draw", t0, t1 - t0, threadId(), -1, {} };
+    record(e);
+
+    FrameStat& f = frames[nframes % FRAME_WINDOW];
+    f.dur = t1 - t0;
+    f.interval = lastframe > 0 ? t0 - lastframe : 0;
+    memcpy(f.phase, curphase, sizeof(curphase));
+    memset(curphase, 0, sizeof(curphase));
+    lastframe = t0;
+    nframes++;
+
+    if (counters.size() >= TRACE_COUNTERS)
+        counters.erase(counters.begin(), counters.begin() + TRACE_COUNTERS / 2);
+    counters.push_back(std::make_pair(t1, c));
+    lastcnt = c;
+}
+
+void MapTrace::tile(int kind, int scale, int ti, int tj, bool cached, qint64 t0)
+{
+    if (!enabled)
+        return;
+    qint64 t1 = now();
+    if (t0 <= 0 || t1 < t0)
+        return;
+
+    QMutexLocker locker(&mutex);
+    TileStat *s;
+    Event e = { "", "tile", t0, t1 - t0, threadId(), kind, {scale, ti, tj} };
+    if (kind == TQ_STRUCT)
+    {
+        e.name = mapopt2str(scale);
+        s = &structs[scale];
+    }
+    else if (kind == TQ_PREVIEW)
+    {
+        e.name = "preview";
+        s = &previews[scaleIndex(scale)];
+    }
+    else
+    {
+        e.name = cached ? "biomes (cached)" : "biomes";
+        s = &biomes[scaleIndex(scale)];
+    }
+    record(e);
+
+    s->n++;
+    s->total += t1 - t0;
+    s->max = std::max(s->max, t1 - t0);
+    if (cached)
+        s->hits++;
+}
+
+QStringList MapTrace::summary()
+{
+    QMutexLocker locker(&mutex);
+    QStringList lines;
+
+    int n = std::min(nframes, (int)FRAME_WINDOW);
+    if (n > 0)
+    {
+        qint64 dur = 0, dmax = 0, interval = 0, ni = 0;
+        qint64 ph[TR_PHASE_NUM] = {};
+        for (int i = 0; i < n; i++)
+        {
+            const FrameStat& f = frames[i];
+            dur += f.dur;
+            dmax = std::max(dmax, f.dur);
+            if (f.interval > 0)
+            {
+                interval += f.interval;
+                ni++;
+            }
+            for (int j = 0; j < TR_PHASE_NUM; j++)
+                ph[j] += f.phase[j];
+        }
+        lines.append(QString::asprintf("帧: %.2f ms 平均, %.2f ms 最大, 间隔 %.1f ms",
+            dur * 1e-3 / n, dmax * 1e-3, ni ? interval * 1e-3 / ni : 0.0));
+        QString s = "绘制:";
+        for (int j = 0; j < TR_PHASE_NUM; j++)
+            s += QString::asprintf(" %s %.2f", phasenames[j], ph[j] * 1e-3 / n);
+        lines.append(s + " ms");
+    }
+
+    const MapCounters& c = lastcnt;
+    lines.append(QString::asprintf("区块: 队列 %d, 运行 %d, 可见层 %d, 缓存 %d",
+        c.queued, c.running, c.levels, c.cached));
+    lines.append(QString::asprintf("内存: 区块 %.1f MB, 磁盘缓存 %.1f MB",
+        c.quadmem / 1048576.0, c.diskcache / 1048576.0));
+
+    for (int i = 0; i < 5; i++)
+    {
+        const TileStat& b = biomes[i];
+        const TileStat& p = previews[i];
+        if (b.n == 0 && p.n == 0)
+            continue;
+        QString s = QString::asprintf("群系 1:%-3d %5lld 个, 平均 %.2f ms, 最大 %.1f ms, 磁盘命中 %lld",
+            1 << (2*i), (long long)b.n, b.n ? b.total * 1e-3 / b.n : 0.0, b.max * 1e-3,
+            (long long)b.hits);
+        if (p.n)
+            s += QString::asprintf(", 预览 %lld 个 %.2f ms", (long long)p.n, p.total * 1e-3 / p.n);
+        lines.append(s);
+    }
+    for (int sopt = 0; sopt < (int)structs.size(); sopt++)
+    {
+        const TileStat& s = structs[sopt];
+        if (s.n == 0)
+            continue;
+        lines.append(QString::asprintf("%-10s %5lld 个, 平均 %.2f ms, 最大 %.1f ms",
+            mapopt2str(sopt), (long long)s.n, s.total * 1e-3 / s.n, s.max * 1e-3));
+    }
+    return lines;
+}
+
+bool MapTrace::exportJson(QString path, QString *err)
+{
+    QMutexLocker locker(&mutex);
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        *err = "打开文件失败";
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+              "\"args\":{\"name\":\"gui\"}}";
+
+    size_t n = events.size();
+    for (size_t k = 0; k < n; k++)
+    {
+        const Event& e = events[wrapped ? (next + k) % n : k];
+        stream << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << e.cat
+               << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+               << ",\"ts\":" << e.ts << ",\"dur\":" << e.dur;
+        if (e.kind >= 0)
+        {
+            stream << ",\"args\":{\"" << (e.kind == TQ_STRUCT ? "option" : "scale")
+                   << "\":" << e.arg[0] << ",\"ti\":" << e.arg[1] << ",\"tj\":" << e.arg[2] << "}";
+        }
+        stream << "}";
+    }
+
+    for (const auto& it : counters)
+    {
+        const MapCounters& c = it.second;
+        stream << ",\n{\"name\":\"tiles\",\"ph\":\"C\",\"pid\":1,\"ts\":" << it.first
+               << ",\"args\":{\"queued\":" << c.queued << ",\"running\":" << c.running
+               << ",\"levels\":" << c.levels << ",\"cached\":" << c.cached << "}}";
+        stream << ",\n{\"name\":\"memory (MB)\",\"ph\":\"C\",\"pid\":1,\"ts\":" << it.first
+               << ",\"args\":{\"tiles\":" << c.quadmem / 1048576.0
+               << ",\"disk cache\":" << c.diskcache / 1048576.0 << "}}";
+    }
+    stream << "\n]}\n";
+    stream.flush();
+
+    if (file.error() != QFile::NoError)
+    {
+        *err = "写入文件失败";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,124 @@
+#ifndef MAPTRACE_H
+#define MAPTRACE_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <vector>
+
+
+// phases of a map frame, in drawing order
+enum
+{
+    TR_FILL,        // coarse fill of unfinished tiles
+    TR_BIOMES,      // biome tiles of the active levels
+    TR_OVERLAYS,    // grid, slime chunks and quad-structure circles
+    TR_STRUCTS,     // structure markers
+    TR_UPDATE,      // level updates, tile scheduling and cache cleanup
+    TR_PHASE_NUM
+};
+
+// kinds of map tile work
+enum { TQ_BIOME, TQ_PREVIEW, TQ_STRUCT };
+
+// state of the map at the end of a frame
+struct MapCounters
+{
+    int queued;         // tiles waiting in the scheduler
+    int running;        // tiles being generated
+    int levels;         // tiles that belong to the visible levels
+    int cached;         // tiles that are kept out of view
+    qint64 quadmem;     // memory held by all tiles in bytes
+    qint64 diskcache;   // size of the disk tile cache in bytes
+};
+
+/* Optional instrumentation of the map rendering.
+ * While enabled, the draw phases of each frame and the generation of each
+ * map tile are recorded with their durations, which are summarized for the
+ * debug overlay of the map and can be exported as a Chrome trace (JSON, as
+ * read by chrome://tracing or Perfetto). The recording functions are
+ * thread-safe and return immediately while the trace is disabled.
+ */
+class MapTrace
+{
+public:
+    MapTrace();
+
+    // enabling the trace discards previous recordings
+    void setEnabled(bool on);
+    bool isEnabled() const { return enabled; }
+
+    // time in microseconds since the trace was enabled
+    qint64 now() const { return timer.nsecsElapsed() / 1000; }
+
+    // end a draw phase that started at t0 (as returned by now() or a
+    // previous phase), returns the end time as start of the next phase
+    qint64 phase(int ph, qint64 t0);
+    // end of a frame that was drawn from t0
+    void frame(qint64 t0, const MapCounters& c);
+    // a map tile has finished a step of work, with scale being the biome
+    // scale or the structure option of structure tiles
+    void tile(int kind, int scale, int ti, int tj, bool cached, qint64 t0);
+
+    // lines of text for the debug overlay
+    QStringList summary();
+
+    bool exportJson(QString path, QString *err);
+
+private:
+    struct Event
+    {
+        const char *name;
+        const char *cat;
+        qint64 ts, dur;
+        int tid;
+        int kind;       // tile kind, or -1 for the frames
+        int arg[3];     // scale (or structure option), ti, tj of tiles
+    };
+
+    struct TileStat
+    {
+        qint64 n, total, max;
+        qint64 hits;    // biome tiles found in the disk cache
+    };
+
+    // frames in the rolling average
+    enum { FRAME_WINDOW = 64 };
+
+    struct FrameStat
+    {
+        qint64 dur;
+        qint64 interval;
+        qint64 phase[TR_PHASE_NUM];
+    };
+
+    void record(const Event& e);
+    int threadId();
+
+    std::atomic_bool enabled;
+    QElapsedTimer timer;
+
+    QMutex mutex;
+    std::vector<Event> events;      // ring buffer of the most recent events
+    size_t next;
+    bool wrapped;
+    std::vector<std::pair<qint64, MapCounters>> counters;
+    QHash<quintptr, int> tids;
+
+    TileStat biomes[5];             // by scale 1:1, 1:4, ... 1:256
+    TileStat previews[5];
+    std::vector<TileStat> structs;  // by structure option
+    FrameStat frames[FRAME_WINDOW];
+    qint64 curphase[TR_PHASE_NUM];
+    qint64 lastframe;
+    int nframes;
+    MapCounters lastcnt;
+};
+
+extern MapTrace g_maptrace;
+
+#endif // MAPTRACE_H
@@ -1,5 +1,6 @@
 #include "mapview.h"
 #include "cutil.h"
+#include "maptrace.h"
 
 #include <QPainter>
 #include <QThread>
@@ -42,12 +43,17 @@ MapView::MapView(QWidget *parent)
 , focusx(),focusz()
 , prevx(),prevz()
 , velx(), velz()
+, mtime()
+, zoomtrend()
 , holding()
 , mstart(),mprev()
 , updatecounter()
 , sshow()
 , hasinertia(true)
 , gridspacing()
+, prefetchtiles(64)
+, membudget(256 << 20)
+, showstats()
 {
     memset(sshow, 0, sizeof(sshow));
 
@@ -88,6 +94,13 @@ void MapView::refresh()
     }
 }
 
+void MapView::refreshBiomeColors()
+{
+    if (world)
+        world->updateBiomeColors();
+    update(2);
+}
+
 void MapView::setSeed(WorldInfo wi, int dim)
 {
     prevx = focusx = getX();
@@ -144,6 +157,25 @@ void MapView::setSetGridSpacing(int spacing)
     update(2);
 }
 
+void MapView::setPrefetch(int tiles)
+{
+    prefetchtiles = tiles;
+    settingsToWorld();
+}
+
+void MapView::setMemoryBudget(qint64 bytes)
+{
+    membudget = bytes;
+    settingsToWorld();
+}
+
+void MapView::setShowStats(bool show)
+{
+    showstats = show;
+    g_maptrace.setEnabled(show);
+    update(2);
+}
+
 void MapView::settingsToWorld()
 {
     if (!world)
@@ -152,6 +184,39 @@ void MapView::settingsToWorld()
         world->sshow[s] = sshow[s];
     world->showBB = showBB;
     world->gridspacing = gridspacing;
+    world->prefetchmax = prefetchtiles;
+    world->membudget = membudget;
+}
+
+void MapView::prefetch(qreal fx, qreal fz)
+{
+    // predict where the view is going: inertial motion comes to rest at
+    // focus + vel, while dragging continues for a moment at the current pace
+    bool predict = false;
+    if (velx || velz)
+    {
+        fx = focusx + velx;
+        fz = focusz + velz;
+        predict = true;
+    }
+    else if (holding && mtime > 0)
+    {
+        qreal dt = 0.5;
+        fx += (focusx - prevx) / mtime * dt;
+        fz += (focusz - prevz) / mtime * dt;
+        predict = (focusx != prevx || focusz != prevz);
+    }
+
+    // a recent zoom is expected to continue for a couple of steps
+    qreal scale = blocks2pix;
+    if (zoomtrend && zoomelapsed.isValid() && zoomelapsed.elapsed() < 500)
+    {
+        scale *= pow(2, 2 * zoomtrend);
+        predict = true;
+    }
+
+    if (predict)
+        world->prefetch(width(), height(), fx, fz, scale);
 }
 
 qreal MapView::getX()
@@ -214,16 +279,26 @@ void MapView::paintEvent(QPaintEvent *)
 
     if (world)
     {
+        qint64 t0 = showstats ? g_maptrace.now() : 0;
         world->draw(painter, width(), height(), fx, fz, blocks2pix);
+        prefetch(fx, fz);
+        if (showstats)
+        {
+            MapCounters c;
+            world->getCounters(&c);
+            g_maptrace.frame(t0, c);
+            drawStats(painter);
+        }
 
         QPoint cur = mapFromGlobal(QCursor::pos());
         qreal bx = (cur.x() -  width()/2.0) / blocks2pix + fx;
         qreal bz = (cur.y() - height()/2.0) / blocks2pix + fz;
         Pos p = {(int)bx, (int)bz};
         overlay->pos = p;
-        overlay->bname = biome2str(world->wi.mc, world->getBiome(p));
+        int id = world->getBiome(p);
+        overlay->bname = id >= 0 ? biome2str(world->wi.mc, id) : NULL;
 
-        if (QThreadPool::globalInstance()->activeThreadCount() > 0 || velx || velz)
+        if (world->isBusy() || velx || velz)
             updatecounter = 2;
         if (updatecounter > 0)
         {
@@ -233,6 +308,22 @@ void MapView::paintEvent(QPaintEvent *)
     }
 }
 
+void MapView::drawStats(QPainter& painter)
+{
+    QFont font = QFont("Monospace", 8);
+    font.setStyleHint(QFont::TypeWriter);
+    painter.setFont(font);
+
+    QString s = g_maptrace.summary().join("\n");
+    QRect r = painter.fontMetrics()
+            .boundingRect(0, 0, width(), height(), Qt::AlignLeft | Qt::AlignBottom, s);
+    r.translate(5, -5); // bottom left, away from the selection and the biome name
+
+    painter.fillRect(r.marginsAdded(QMargins(4, 4, 4, 4)), QBrush(QColor(0, 0, 0, 160), Qt::SolidPattern));
+    painter.setPen(Qt::white);
+    painter.drawText(r, Qt::AlignLeft | Qt::AlignTop, s);
+}
+
 void MapView::resizeEvent(QResizeEvent *e)
 {
     QWidget::resizeEvent(e);
@@ -243,6 +334,8 @@ void MapView::wheelEvent(QWheelEvent *e)
 {
     const qreal ang = e->angleDelta().y() / 8; // e->delta() / 8;
     blocks2pix *= pow(2, ang/100);
+    zoomtrend = ang/100;
+    zoomelapsed.start();
     qreal scalemin = 128.0, scalemax = 1.0 / 1024.0;
     if (blocks2pix > scalemin) blocks2pix = scalemin;
     if (blocks2pix < scalemax) blocks2pix = scalemax;
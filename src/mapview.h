@@ -38,6 +38,7 @@ public:
 
     void deleteWorld();
     void refresh();
+    void refreshBiomeColors();
     void setSeed(WorldInfo wi, int dim);
     void setView(qreal x, qreal z, qreal scale = 0);
 
@@ -46,6 +47,10 @@ public:
     void setShowBB(bool show);
     void setSmoothMotion(bool smooth);
     void setSetGridSpacing(int spacing);
+    void setPrefetch(int tiles);
+    void setMemoryBudget(qint64 bytes);
+    // render statistics overlay (enables the map trace)
+    void setShowStats(bool show);
 
     void timeout();
 
@@ -55,6 +60,8 @@ public:
 
 private:
     void settingsToWorld();
+    void prefetch(qreal fx, qreal fz);
+    void drawStats(QPainter& painter);
 
 signals:
 
@@ -74,6 +81,7 @@ public:
 
     QElapsedTimer elapsed1;
     QElapsedTimer frameelapsed;
+    QElapsedTimer zoomelapsed;
     qreal decay;
 
     MapOverlay *overlay;
@@ -84,6 +92,7 @@ private:
     qreal prevx, prevz;
     qreal velx, velz;
     qreal mtime;
+    qreal zoomtrend; // recent zoom direction (log2 of scale change per step)
 
     bool holding;
     QPoint mstart, mprev;
@@ -93,6 +102,9 @@ private:
     bool showBB;
     bool hasinertia;
     int gridspacing;
+    int prefetchtiles;
+    qint64 membudget;
+    bool showstats;
 };
 
 #endif // MAPVIEW_H
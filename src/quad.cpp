@@ -1,46 +1,102 @@
 #include "quad.h"
 
 #include "cutil.h"
+#include "tilecache.h"
+#include "tilescheduler.h"
+#include "maptrace.h"
 
 #include <QThreadPool>
+#include <QSet>
 
 #include <cmath>
+#include <cstring>
 #include <algorithm>
-
-#define SEAM_BUF 8
+#include <map>
+#include <tuple>
 
 
 Quad::Quad(const Level* l, int i, int j)
-    : wi(l->wi),dim(l->dim),g(&l->g),scale(l->scale)
+    : world(l->world),wi(l->wi),dim(l->dim),g(&l->g),scale(l->scale)
     , ti(i),tj(j),blocks(l->blocks),pixs(l->pixs),sopt(l->sopt)
-    , rgb(),img(),spos()
-    , done(),isdel(l->isdel)
-    , prio(),stopped()
+    , img(),preview(),spos()
+    , done(),needfull(),isdel(l->isdel)
+    , prio(),stopped(),colorver(),previewver(),speculative(),schedprio()
+    , lastused()
 {
     setAutoDelete(false);
+    world->quadmem.fetchAndAddRelaxed(sizeof(Quad));
 }
 
 Quad::~Quad()
 {
-    delete [] rgb;
+    world->quadmem.fetchAndAddRelaxed(-memSize());
     delete img;
+    delete preview;
     delete spos;
 }
 
+SlimeTile::SlimeTile(uint64_t seed, int ti, int tj)
+    : seed(seed),ti(ti),tj(tj),img()
+{
+    setAutoDelete(false);
+}
+
+SlimeTile::~SlimeTile()
+{
+    delete img;
+}
+
+void SlimeTile::run()
+{
+    QImage *im = new QImage(SLIME_TILE, SLIME_TILE, QImage::Format_Indexed8);
+    im->setColor(0, qRgba(0, 0, 0, 64));
+    im->setColor(1, qRgba(0, 255, 0, 64));
+    int x = ti * SLIME_TILE, z = tj * SLIME_TILE;
+    for (int j = 0; j < SLIME_TILE; j++)
+    {
+        uchar *line = im->scanLine(j);
+        for (int i = 0; i < SLIME_TILE; i++)
+            line[i] = isSlimeChunk(seed, x+i, z+j);
+    }
+    img = im;
+}
+
+static qint64 imageBytes(const QImage *img)
+{
+    if (!img)
+        return 0;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    return sizeof(QImage) + img->sizeInBytes();
+#else
+    return sizeof(QImage) + img->byteCount();
+#endif
+}
+
+static qint64 sposBytes(const std::vector<VarPos> *sp)
+{
+    if (!sp)
+        return 0;
+    return sizeof(*sp) + sp->capacity() * sizeof(VarPos);
+}
+
+qint64 Quad::memSize() const
+{
+    qint64 n = sizeof(Quad);
+    n += imageBytes(img.loadAcquire());
+    n += imageBytes(preview.loadAcquire());
+    n += sposBytes(spos.loadAcquire());
+    return n;
+}
+
 void getStructs(std::vector<VarPos> *out, const StructureConfig sconf,
-        WorldInfo wi, int dim, int x0, int z0, int x1, int z1)
+        WorldInfo wi, Generator *g, SurfaceNoise *sne,
+        int x0, int z0, int x1, int z1)
 {
     int si0 = (int)floor(x0 / (qreal)(sconf.regionSize * 16));
     int sj0 = (int)floor(z0 / (qreal)(sconf.regionSize * 16));
     int si1 = (int)floor((x1-1) / (qreal)(sconf.regionSize * 16));
     int sj1 = (int)floor((z1-1) / (qreal)(sconf.regionSize * 16));
 
-    // TODO: move generator to arguments?
-    //       isViableStructurePos would have to be const (due to threading)
-    Generator g;
-    setupGenerator(&g, wi.mc, wi.large);
-    applySeed(&g, dim, wi.seed);
-
     for (int i = si0; i <= si1; i++)
     {
         for (int j = sj0; j <= sj1; j++)
@@ -51,21 +107,19 @@ void getStructs(std::vector<VarPos> *out, const StructureConfig sconf,
 
             if (p.x >= x0 && p.x < x1 && p.z >= z0 && p.z < z1)
             {
-                int id = isViableStructurePos(sconf.structType, &g, p.x, p.z, 0);
+                int id = isViableStructurePos(sconf.structType, g, p.x, p.z, 0);
                 if (!id)
                     continue;
 
                 if (sconf.structType == End_City)
                 {
-                    SurfaceNoise sn;
-                    initSurfaceNoiseEnd(&sn, wi.seed);
-                    id = isViableEndCityTerrain(&g.en, &sn, p.x, p.z);
+                    id = isViableEndCityTerrain(&g->en, sne, p.x, p.z);
                     if (!id)
                         continue;
                 }
-                else if (g.mc >= MC_1_18)
+                else if (g->mc >= MC_1_18)
                 {
-                    if (!isViableStructureTerrain(sconf.structType, &g, p.x, p.z))
+                    if (!isViableStructureTerrain(sconf.structType, g, p.x, p.z))
                         continue;
                 }
 
@@ -101,34 +155,89 @@ void getStructs(std::vector<VarPos> *out, const StructureConfig sconf,
 
 
 
+QImage *biomeImage(const int *b, int w, int h)
+{
+    QImage *im = new QImage(w, h, QImage::Format_Indexed8);
+    for (int j = 0; j < h; j++)
+    {
+        uchar *line = im->scanLine(j);
+        for (int i = 0; i < w; i++)
+        {
+            int id = b[j*w + i];
+            line[i] = (id >= 0 && id < TILE_NONE) ? id : TILE_NONE;
+        }
+    }
+    return im;
+}
+
+// the full resolution pass of a tile is queued behind the previews of its level
+#define PREVIEW_DEFER (1LL << 31)
+
 void Quad::run()
 {
     if (done || *isdel)
         return;
 
+    qint64 t0 = g_maptrace.isEnabled() ? g_maptrace.now() : 0;
+
     if (pixs > 0)
     {
         int y = (scale > 1) ? wi.y >> 2 : wi.y;
-        int x = ti*pixs, z = tj*pixs, w = pixs+SEAM_BUF, h = pixs+SEAM_BUF;
+        int x = ti*pixs, z = tj*pixs, w = pixs, h = pixs;
+        TileKey key = { wi.mc, mapGenFlags(wi), wi.seed, dim, y, scale, pixs, ti, tj };
+
+        // 1.18+ tiles are expensive: first generate a preview at a quarter of
+        // the resolution, so the view fills quickly, and then have the
+        // controller requeue the tile for the full resolution
+        if (!preview && wi.mc >= MC_1_18 && scale <= 64 && !g_tilecache.contains(key))
+        {
+            int pscale = scale * 4;
+            int pw = w / 4, ph = h / 4;
+            Range pr = {pscale, x/4, z/4, pw, ph, wi.y >> 2, 1};
+            int *pb = allocCache(g, pr);
+            if (genBiomes(g, pb, pr))
+            {
+                for (int i = 0; i < pw*ph; i++)
+                    pb[i] = -1;
+            }
+            QImage *pimg = biomeImage(pb, pw, ph);
+            world->quadmem.fetchAndAddRelaxed(imageBytes(pimg));
+            preview = pimg;
+            free(pb);
+            g_maptrace.tile(TQ_PREVIEW, scale, ti, tj, false, t0);
+            needfull = true;
+            world->nneedfull.fetchAndAddRelease(1);
+            return;
+        }
+
         Range r = {scale, x, z, w, h, y, 1};
         int *b = allocCache(g, r);
-        int err = genBiomes(g, b, r);
-        if (err)
-        {
-            fprintf(
-                stderr,
-                "生成失败 tile - "
-                "MC:%s seed:%" PRId64 " dim:%d @ [%d %d] (%d %d) 1:%d\n",
-                mc2str(g->mc), g->seed, g->dim,
-                x, z, w, h, scale);
-            for (int i = 0; i < w*h; i++)
-                b[i] = -1;
-        }
-
-        rgb = new uchar[w*h * 3];
-        biomesToImage(rgb, biomeColors, b, w, h, 1, 1);
-        img = new QImage(rgb, w, h, 3*w, QImage::Format_RGB888);
+        bool cached = g_tilecache.load(key, b, w*h);
+        if (!cached)
+        {
+            int err = genBiomes(g, b, r);
+            if (err)
+            {
+                fprintf(
+                    stderr,
+                    "生成失败 tile - "
+                    "MC:%s seed:%" PRId64 " dim:%d @ [%d %d] (%d %d) 1:%d\n",
+                    mc2str(g->mc), g->seed, g->dim,
+                    x, z, w, h, scale);
+                for (int i = 0; i < w*h; i++)
+                    b[i] = -1;
+            }
+            else if (!*isdel)
+            {
+                g_tilecache.store(key, b, w*h);
+            }
+        }
+
+        QImage *im = biomeImage(b, w, h);
+        world->quadmem.fetchAndAddRelaxed(imageBytes(im));
+        img = im;
         free(b);
+        g_maptrace.tile(TQ_BIOME, scale, ti, tj, cached, t0);
     }
     else
     {
@@ -140,8 +249,14 @@ void Quad::run()
             std::vector<VarPos>* st = new std::vector<VarPos>();
             StructureConfig sconf;
             if (getStructureConfig_override(structureType, wi.mc, &sconf))
-                getStructs(st, sconf, wi, dim, x0, z0, x1, z1);
+            {
+                Generator *sg = world->acquireGenerator(dim);
+                getStructs(st, sconf, wi, sg, &world->sne, x0, z0, x1, z1);
+                world->releaseGenerator(sg);
+            }
+            world->quadmem.fetchAndAddRelaxed(sposBytes(st));
             spos = st;
+            g_maptrace.tile(TQ_STRUCT, sopt, ti, tj, false, t0);
         }
     }
     done = true;
@@ -149,16 +264,29 @@ void Quad::run()
 
 
 Level::Level()
-    : cells(),g(),entry(),wi(),dim()
+    : cells(),g(),entry(),world(),wi(),dim()
     , tx(),tz(),tw(),th()
     , scale(),blocks(),pixs()
     , sopt()
 {
 }
 
+bool Level::cellRange(qreal x0, qreal z0, qreal x1, qreal z1,
+        int *i0, int *j0, int *i1, int *j1) const
+{
+    if ((int)cells.size() != tw * th || blocks <= 0)
+        return false;
+    *i0 = std::max((int) floor(x0 / blocks), tx) - tx;
+    *j0 = std::max((int) floor(z0 / blocks), tz) - tz;
+    *i1 = std::min((int) floor(x1 / blocks), tx+tw-1) - tx;
+    *j1 = std::min((int) floor(z1 / blocks), tz+th-1) - tz;
+    return *i0 <= *i1 && *j0 <= *j1;
+}
+
 Level::~Level()
 {
-    QThreadPool::globalInstance()->waitForDone();
+    if (!cells.empty())
+        g_mapsched.waitForDone(world);
     for (Quad *q : cells)
         delete q;
 }
@@ -166,6 +294,7 @@ Level::~Level()
 
 void Level::init4map(QWorld *w, int dim, int pix, int layerscale)
 {
+    this->world = w;
     this->wi = w->wi;
     this->dim = dim;
 
@@ -175,13 +304,14 @@ void Level::init4map(QWorld *w, int dim, int pix, int layerscale)
     blocks = pix * layerscale;
     sopt = D_NONE;
 
-    setupGenerator(&g, wi.mc, wi.large | FORCE_OCEAN_VARIANTS);
+    setupGenerator(&g, wi.mc, mapGenFlags(wi));
     applySeed(&g, dim, wi.seed);
     this->isdel = &w->isdel;
 }
 
 void Level::init4struct(QWorld *w, int dim, int blocks, int sopt, int lv)
 {
+    this->world = w;
     this->wi = w->wi;
     this->dim = dim;
     this->blocks = blocks;
@@ -194,6 +324,17 @@ void Level::init4struct(QWorld *w, int dim, int blocks, int sopt, int lv)
 
 static int sqdist(int x, int z) { return x*x + z*z; }
 
+// scheduling order of the map tiles: coarse biome levels first, then finer
+// levels, then the structure levels (scale -1), and finally the prefetched
+// tiles, with each level sorted by the distance to the view
+static qint64 tilePrio(int scale, int prio)
+{
+    return -(qint64)scale * (1LL << 32) + prio;
+}
+#define PREFETCH_PRIO(d) ((2LL << 32) + (d))
+// the slime tiles are cheap and go ahead of everything else
+#define SLIME_PRIO(d) (-(1LL << 48) + (d))
+
 void Level::resizeLevel(std::vector<Quad*>& cache, int x, int z, int w, int h)
 {
     // move the cells from the old grid to the new grid
@@ -220,17 +361,21 @@ void Level::resizeLevel(std::vector<Quad*>& cache, int x, int z, int w, int h)
 
         if (c->blocks == blocks && c->sopt == sopt && c->dim == dim)
         {
-            // remove outside quads from schedule
-            if (QThreadPool::globalInstance()->tryTake(c))
+            bool inside = (gx >= 0 && gx < w && gz >= 0 && gz < h);
+
+            // remove outside quads from schedule (prefetched quads may still
+            // become visible and continue at their lower priority)
+            if ((inside || !c->speculative) && g_mapsched.cancel(c))
             {
                 c->stopped = true;
             }
 
-            if (gx >= 0 && gx < w && gz >= 0 && gz < h)
+            if (inside)
             {
                 Quad *& g = grid[gz*w + gx];
                 if (g == NULL)
                 {
+                    c->speculative = false;
                     g = c;
                     continue;
                 }
@@ -252,14 +397,12 @@ void Level::resizeLevel(std::vector<Quad*>& cache, int x, int z, int w, int h)
                 g->prio = sqdist(i-w/2, j-h/2);
                 togen.push_back(g);
             }
-            else if (g->stopped || QThreadPool::globalInstance()->tryTake(g))
+            else if (g->stopped || g_mapsched.cancel(g))
             {
                 if (!g->done)
                 {
                     g->stopped = false;
                     g->prio = sqdist(i-w/2, j-h/2);
-                    if (g->dim != dim)
-                        g->prio += 1000000;
                     togen.push_back(g);
                 }
             }
@@ -270,7 +413,7 @@ void Level::resizeLevel(std::vector<Quad*>& cache, int x, int z, int w, int h)
     std::sort(togen.begin(), togen.end(),
               [](Quad* a, Quad* b) { return a->prio < b->prio; });
     for (Quad *q : togen)
-        QThreadPool::globalInstance()->start(q, scale);
+        world->schedule(q, tilePrio(scale, q->prio));
 
     cells.swap(grid);
     tx = x;
@@ -303,21 +446,38 @@ void Level::update(std::vector<Quad*>& cache, qreal bx0, qreal bz0, qreal bx1, q
 QWorld::QWorld(WorldInfo wi, int dim)
     : wi(wi)
     , dim(dim)
+    , genpool()
+    , sne()
     , lvb()
     , lvs()
+    , lvbdim()
     , activelv()
     , cachedbiomes()
     , cachedstruct()
-    , cachesize()
+    , membudget(256 << 20)
+    , quadmem()
+    , frame()
+    , nneedfull()
+    , prefetched()
+    , prefetchmax(64)
+    , prefetchkey()
+    , prefetchmore()
     , showBB()
     , gridspacing()
+    , biomecolors()
+    , colorver()
     , spawn()
     , strongholds()
     , qsinfo()
     , isdel()
-    , slimeimg()
-    , slimex()
-    , slimez()
+    , bgpool()
+    , bgdel()
+    , hovermutex()
+    , hoverreq(),hoverpos()
+    , hoverreqdim(),hoverdim()
+    , hoverid(-1)
+    , hoverbusy()
+    , slimetiles()
     , seldo()
     , selx()
     , selz()
@@ -326,24 +486,13 @@ QWorld::QWorld(WorldInfo wi, int dim)
     , selvar()
     , qual()
 {
-    setupGenerator(&g, wi.mc,  wi.large);
+    setupGenerator(&g, wi.mc, mapGenFlags(wi));
     applySeed(&g, dim, wi.seed);
+    initSurfaceNoiseEnd(&sne, wi.seed);
 
     activelv = 0;
 
-    int pixs;
-    if (g.mc >= MC_1_18)
-    {
-        pixs = 128;
-        cachesize = 1000;
-        qual = 1.7;
-    }
-    else
-    {
-        pixs = 512;
-        cachesize = 100;
-        qual = 1.0;
-    }
+    qual = g.mc >= MC_1_18 ? 1.7 : 1.0;
 
     lvs.resize(D_SPAWN);
     lvs[D_DESERT]       .init4struct(this, 0, 2048, D_DESERT, 2);
@@ -365,26 +514,12 @@ QWorld::QWorld(WorldInfo wi, int dim)
     lvs[D_GATEWAY]      .init4struct(this, 1, 2048, D_GATEWAY, 2);
     lvs[D_MINESHAFT]    .init4struct(this, 0, 2048, D_MINESHAFT, 1);
 
-    if (dim == 0)
-    {
-        lvb.resize(5);
-        lvb[0].init4map(this, dim, pixs, 1);
-        lvb[1].init4map(this, dim, pixs, 4);
-        lvb[2].init4map(this, dim, pixs, 16);
-        lvb[3].init4map(this, dim, pixs, 64);
-        lvb[4].init4map(this, dim, pixs, 256);
-    }
-    else
-    {
-        lvb.resize(4);
-        lvb[0].init4map(this, dim, pixs, 1);
-        lvb[1].init4map(this, dim, pixs, 4);
-        lvb[2].init4map(this, dim, pixs, 16);
-        lvb[3].init4map(this, dim, pixs, 64);
-    }
+    initLevels();
 
     memset(sshow, 0, sizeof(sshow));
 
+    updateBiomeColors();
+
     icons[D_DESERT]     = QPixmap(":/icons/desert.png");
     icons[D_JUNGLE]     = QPixmap(":/icons/jungle.png");
     icons[D_IGLOO]      = QPixmap(":/icons/igloo.png");
@@ -411,11 +546,18 @@ QWorld::QWorld(WorldInfo wi, int dim)
 
 QWorld::~QWorld()
 {
+    bgdel = true;
     clearPool();
+    bgpool.waitForDone();
     for (Quad *q : cachedbiomes)
         delete q;
     for (Quad *q : cachedstruct)
         delete q;
+    for (SlimeTile *s : slimetiles)
+        delete s;
+    for (std::vector<Generator*>& gens : genpool)
+        for (Generator *sg : gens)
+            delete sg;
     if (spawn && spawn != (Pos*)-1)
     {
         delete spawn;
@@ -427,48 +569,71 @@ QWorld::~QWorld()
 void QWorld::clearPool()
 {
     isdel = true;
-    QThreadPool::globalInstance()->clear();
-    QThreadPool::globalInstance()->waitForDone();
+    // only the tiles of this world are cancelled
+    g_mapsched.clear(this);
+    g_mapsched.waitForDone(this);
     isdel = false;
+
+    // nothing is queued anymore, so unfinished quads have to be restarted
+    auto stop = [](Quad *q) { if (!q->done) q->stopped = true; };
+    for (const std::vector<Level>* lv : { &lvb, &lvs })
+        for (const Level& l : *lv)
+            std::for_each(l.cells.begin(), l.cells.end(), stop);
+    std::for_each(cachedbiomes.begin(), cachedbiomes.end(), stop);
+    std::for_each(cachedstruct.begin(), cachedstruct.end(), stop);
+
+    // slime tiles that were removed from the queue are requested again
+    for (auto it = slimetiles.begin(); it != slimetiles.end(); )
+    {
+        if (!it.value()->img)
+        {
+            delete it.value();
+            it = slimetiles.erase(it);
+        }
+        else ++it;
+    }
+}
+
+bool QWorld::isBusy()
+{
+    return g_mapsched.pending(this) > 0 || nneedfull.loadAcquire() > 0 || bgpool.activeThreadCount() > 0;
 }
 
 void QWorld::setDim(int dim)
 {
+    int olddim = this->dim;
     clearPool();
     this->dim = dim;
     applySeed(&g, dim, wi.seed);
 
-    // cache existing quads
+    prefetched.clear();
+    prefetchmore = false;
+    prefetchkey[0] = -1;
+
+    // the quads of the previous dimension go to the cache, where they are
+    // subject to the memory budget and get picked up again by the levels
+    // when switching back (unfinished ones continue from there)
     for (Level& l : lvb)
     {
-        std::vector<Quad*> todel;
         for (Quad *q : l.cells)
-        {
-            if (q->done)
-                cachedbiomes.push_back(q);
-            else
-                todel.push_back(q);
-        }
-        l.cells.swap(todel);
+            cachedbiomes.push_back(q);
+        l.cells.clear();
+        l.tx = l.tz = l.tw = l.th = 0;
     }
 
-    int pixs;
-    if (g.mc >= MC_1_18)
-    {
-        pixs = 128;
-        cachesize = 1000;
-        qual = 1.7;
-    }
-    else
-    {
-        pixs = 512;
-        cachesize = 100;
-        qual = 1.0;
-    }
+    // the levels are kept per dimension, since the cached quads refer to
+    // their generators
+    lvbdim[olddim+1].swap(lvb);
+    lvb.swap(lvbdim[dim+1]);
+    if (lvb.empty())
+        initLevels();
 
-    cleancache(cachedbiomes, (int)(cachesize));
+    cleancache();
+}
 
-    lvb.clear();
+void QWorld::initLevels()
+{
+    int pixs = mapTilePixels(g.mc);
 
     if (dim == 0)
     {
@@ -489,38 +654,196 @@ void QWorld::setDim(int dim)
     }
 }
 
-int QWorld::getBiome(Pos p)
+static inline int floordiv(int a, int b)
 {
-    int id = getBiomeAt(&g, 1, p.x, wi.y, p.z);
-    return id;
+    return a >= 0 ? a / b : -1 - (-1 - a) / b;
 }
 
-void QWorld::cleancache(std::vector<Quad*>& cache, unsigned int maxsize)
+struct BiomeLookup : public QRunnable
 {
-    // try to delete the oldest entries in the cache
-    if (cache.size() > maxsize)
+    QWorld *world;
+
+    BiomeLookup(QWorld *world) : world(world) {}
+
+    void run()
     {
-        std::vector<Quad*> newcache;
-        int i;
-        for (i = cache.size()-1; i >= 0; --i)
+        // the exact biome has to agree with the tiles, so it is generated
+        // with the flags of the map rather than those of the structures
+        Generator g;
+        setupGenerator(&g, world->wi.mc, mapGenFlags(world->wi));
+        int gdim = -2; // not seeded yet
+
+        QMutexLocker locker(&world->hovermutex);
+        while (!world->bgdel)
         {
-            Quad *q = cache[i];
-            if (newcache.size() + i < maxsize * 0.8)
-            {
-                newcache.push_back(q);
-            }
-            else
+            Pos p = world->hoverreq;
+            int dim = world->hoverreqdim;
+            locker.unlock();
+
+            if (dim != gdim)
             {
-                if (q->done || q->stopped || QThreadPool::globalInstance()->tryTake(q))
-                    delete q;
-                else
-                    newcache.push_back(q);
+                applySeed(&g, dim, world->wi.seed);
+                gdim = dim;
             }
+            int id = getBiomeAt(&g, 1, p.x, world->wi.y, p.z);
+
+            locker.relock();
+            world->hoverpos = p;
+            world->hoverdim = dim;
+            world->hoverid = id;
+            // continue with the latest position if the mouse has moved on
+            if (world->hoverreq.x == p.x && world->hoverreq.z == p.z &&
+                world->hoverreqdim == dim)
+                break;
         }
+        world->hoverbusy = false;
+    }
+};
+
+int QWorld::getBiome(Pos p)
+{
+    {
+        QMutexLocker locker(&hovermutex);
+        if (hoverid >= 0 && hoverpos.x == p.x && hoverpos.z == p.z && hoverdim == dim)
+            return hoverid;
+    }
+
+    // read the biome from the finest generated tile that covers the position
+    int id = -1;
+    for (Level& l : lvb)
+    {
+        int ti = floordiv(p.x, l.blocks);
+        int tj = floordiv(p.z, l.blocks);
+        if (ti < l.tx || ti >= l.tx+l.tw || tj < l.tz || tj >= l.tz+l.th)
+            continue;
+        if ((int)l.cells.size() != l.tw * l.th)
+            continue;
+        Quad *q = l.cells[(tj - l.tz) * l.tw + (ti - l.tx)];
+        const QImage *img = q->img; // atomic fetch
+        if (!img)
+            continue;
+        int i = floordiv(p.x, l.scale) - ti * l.pixs;
+        int j = floordiv(p.z, l.scale) - tj * l.pixs;
+        int tid = img->constScanLine(j)[i];
+        if (tid == TILE_NONE)
+            continue;
+        if (l.scale == 1)
+            return tid; // exact
+        id = tid;
+        break;
+    }
 
-        cache.resize(newcache.size());
-        std::copy(newcache.rbegin(), newcache.rend(), cache.begin());
+    // never generate on the calling (UI) thread
+    QMutexLocker locker(&hovermutex);
+    hoverreq = p;
+    hoverreqdim = dim;
+    if (!hoverbusy && !bgdel)
+    {
+        hoverbusy = true;
+        bgpool.start(new BiomeLookup(this));
     }
+    return id;
+}
+
+void QWorld::updateBiomeColors()
+{
+    biomecolors.resize(256);
+    for (int i = 0; i < 256; i++)
+        biomecolors[i] = qRgb(biomeColors[i][0], biomeColors[i][1], biomeColors[i][2]);
+    biomecolors[TILE_NONE] = qRgb(0, 0, 0);
+    colorver++;
+}
+
+Generator *QWorld::acquireGenerator(int dim)
+{
+    {
+        QMutexLocker locker(&genmutex);
+        std::vector<Generator*>& gens = genpool[dim+1];
+        if (!gens.empty())
+        {
+            Generator *sg = gens.back();
+            gens.pop_back();
+            return sg;
+        }
+    }
+    Generator *sg = new Generator;
+    setupGenerator(sg, wi.mc, wi.large);
+    applySeed(sg, dim, wi.seed);
+    return sg;
+}
+
+void QWorld::releaseGenerator(Generator *sg)
+{
+    QMutexLocker locker(&genmutex);
+    genpool[sg->dim+1].push_back(sg);
+}
+
+void QWorld::cleancache()
+{
+    // runs every frame, so the quads are only visited when the running
+    // total is over the budget
+    if (quadmem.loadAcquire() <= membudget)
+        return;
+
+    // the budget applies to all quads, but only the cached ones can be freed
+    qint64 total = 0;
+    for (const std::vector<Level>* lv : { &lvb, &lvs })
+        for (const Level& l : *lv)
+            for (const Quad *q : l.cells)
+                total += q->memSize();
+
+    std::vector<std::pair<qint64, Quad*>> order;
+    order.reserve(cachedbiomes.size() + cachedstruct.size());
+    for (Quad *q : cachedbiomes)
+    {
+        total += q->memSize();
+        order.push_back(std::make_pair(q->lastused, q));
+    }
+    for (Quad *q : cachedstruct)
+    {
+        total += q->memSize();
+        order.push_back(std::make_pair(q->lastused, q));
+    }
+    if (total <= membudget)
+        return;
+
+    // free the least recently used quads until there is some headroom
+    std::sort(order.begin(), order.end(),
+              [](const std::pair<qint64, Quad*>& a, const std::pair<qint64, Quad*>& b) {
+        return a.first < b.first;
+    });
+    qint64 target = membudget - membudget / 5;
+    QSet<Quad*> todel;
+    for (const auto& o : order)
+    {
+        if (total <= target)
+            break;
+        Quad *q = o.second;
+        if (q->done || q->stopped || g_mapsched.cancel(q))
+        {
+            total -= q->memSize();
+            todel.insert(q);
+        }
+    }
+    if (todel.isEmpty())
+        return;
+
+    for (std::vector<Quad*>* cache : { &cachedbiomes, &cachedstruct })
+    {
+        std::vector<Quad*> keep;
+        keep.reserve(cache->size());
+        for (Quad *q : *cache)
+        {
+            if (todel.contains(q))
+                continue;
+            keep.push_back(q);
+        }
+        cache->swap(keep);
+    }
+    prefetched.erase(std::remove_if(prefetched.begin(), prefetched.end(),
+        [&](Quad *q) { return todel.contains(q); }), prefetched.end());
+    for (Quad *q : todel)
+        delete q;
 }
 
 
@@ -541,7 +864,7 @@ struct SpawnStronghold : public QRunnable
         Pos *p = new Pos;
         *p = getSpawn(&g);
         world->spawn = p;
-        if (world->isdel) return;
+        if (world->bgdel) return;
 
         StrongholdIter sh;
         initFirstStronghold(&sh, wi.mc, wi.seed);
@@ -551,7 +874,7 @@ struct SpawnStronghold : public QRunnable
 
         while (nextStronghold(&sh, &g) > 0)
         {
-            if (world->isdel)
+            if (world->bgdel)
             {
                 delete shp;
                 return;
@@ -561,12 +884,14 @@ struct SpawnStronghold : public QRunnable
 
         world->strongholds = shp;
 
+        // the scan leaves half of the threads to the map tiles
         QVector<QuadInfo> *qsinfo = new QVector<QuadInfo>;
-
-        if (!world->isdel)
-            findQuadStructs(Swamp_Hut, &g, qsinfo);
-        if (!world->isdel)
-            findQuadStructs(Monument, &g, qsinfo);
+        int threads = std::max(1, QThread::idealThreadCount() / 2);
+        if (!scanQuadStructs(wi.mc, wi.large, wi.seed, qsinfo, &world->bgdel, threads))
+        {
+            delete qsinfo;
+            return;
+        }
 
         world->qsinfo = qsinfo;
     }
@@ -600,6 +925,230 @@ static bool draw_grid_rec(QPainter& painter, QRect &rec, qreal pix, int x, int z
     return true;
 }
 
+void QWorld::schedule(Quad *q, qint64 prio)
+{
+    q->schedprio = prio;
+    g_mapsched.start(q, prio, this);
+}
+
+void QWorld::requeuePreviews()
+{
+    if (nneedfull.loadAcquire() == 0)
+        return;
+
+    auto requeue = [&](Quad *q, bool active) {
+        bool expected = true;
+        if (!q->needfull.compare_exchange_strong(expected, false))
+            return;
+        nneedfull.fetchAndAddRelease(-1);
+        if (q->stopped || q->done)
+            return; // restarted by its level when it is needed again
+        if (active)
+            schedule(q, q->schedprio + PREVIEW_DEFER);
+        else
+            q->stopped = true;
+    };
+    for (Level& l : lvb)
+        for (Quad *q : l.cells)
+            requeue(q, true);
+    // the cells of inactive dimensions are moved to the cache (see setDim)
+    for (Quad *q : cachedbiomes)
+        requeue(q, q->speculative);
+}
+
+void QWorld::applyColors(QImage *img, int *ver)
+{
+    if (*ver != colorver)
+    {
+        img->setColorTable(biomecolors);
+        *ver = colorver;
+    }
+}
+
+int QWorld::getLevel(qreal blocks2pix) const
+{
+    if      (blocks2pix >= qual)     return -1;
+    else if (blocks2pix >= qual/4)   return 0;
+    else if (blocks2pix >= qual/16)  return 1;
+    else if (blocks2pix >= qual/64)  return 2;
+    else if (blocks2pix >= qual/256) return 3;
+    else return lvb.size()-1;
+}
+
+void QWorld::prefetch(int vw, int vh, qreal focusx, qreal focusz, qreal blocks2pix)
+{
+    int li = getLevel(blocks2pix);
+    if (li < 0)
+        li = 0;
+    if (li >= (int)lvb.size() || prefetchmax <= 0)
+        return;
+    Level& l = lvb[li];
+
+    qreal uiw = vw / blocks2pix;
+    qreal uih = vh / blocks2pix;
+    int key[5] = {
+        li,
+        (int) std::floor((focusx - uiw/2) / l.blocks),
+        (int) std::floor((focusz - uih/2) / l.blocks),
+        (int) std::floor((focusx + uiw/2) / l.blocks) + 1,
+        (int) std::floor((focusz + uih/2) / l.blocks) + 1,
+    };
+    if (!prefetchmore && !memcmp(key, prefetchkey, sizeof(key)))
+        return;
+    memcpy(prefetchkey, key, sizeof(key));
+    int ti0 = key[1], tj0 = key[2], ti1 = key[3], tj1 = key[4];
+
+    // release the speculative tiles that are outside of the new prediction,
+    // they remain in the cache as ordinary tiles
+    std::vector<Quad*> keep;
+    int queued = 0;
+    for (Quad *q : prefetched)
+    {
+        if (!q->speculative)
+            continue; // has been adopted by a level
+        if (q->blocks == l.blocks && q->dim == dim &&
+            q->ti >= ti0 && q->ti < ti1 && q->tj >= tj0 && q->tj < tj1)
+        {
+            keep.push_back(q);
+            if (!q->done && !q->stopped)
+                queued++;
+            continue;
+        }
+        if (!q->done && !q->stopped && g_mapsched.cancel(q))
+            q->stopped = true;
+        q->speculative = false;
+    }
+    prefetched.swap(keep);
+
+    // find the predicted tiles that are not part of the level, and whether
+    // the cache already holds them (descheduled quads can be restarted)
+    int pw = ti1 - ti0, ph = tj1 - tj0;
+    std::vector<Quad*> found(pw * ph);
+    for (Quad *q : cachedbiomes)
+    {
+        if (q->blocks != l.blocks || q->dim != dim)
+            continue;
+        if (q->ti < ti0 || q->ti >= ti1 || q->tj < tj0 || q->tj >= tj1)
+            continue;
+        Quad *& f = found[(q->tj - tj0) * pw + (q->ti - ti0)];
+        if (f == NULL || !(q->stopped && !q->done))
+            f = q;
+    }
+
+    struct Cand { int i, j, d; Quad *q; };
+    std::vector<Cand> missing;
+    int ci = (ti0 + ti1) / 2, cj = (tj0 + tj1) / 2;
+    for (int j = tj0; j < tj1; j++)
+    {
+        for (int i = ti0; i < ti1; i++)
+        {
+            if (i >= l.tx && i < l.tx+l.tw && j >= l.tz && j < l.tz+l.th)
+                continue;
+            Quad *q = found[(j - tj0) * pw + (i - ti0)];
+            if (q && !(q->stopped && !q->done))
+                continue; // already generated or queued
+            Cand c = { i, j, sqdist(i-ci, j-cj), q };
+            missing.push_back(c);
+        }
+    }
+    std::sort(missing.begin(), missing.end(),
+              [](const Cand& a, const Cand& b) { return a.d < b.d; });
+
+    // the speculative work only occupies part of the thread pool and
+    // always has a lower priority than the tiles of the visible levels
+    int maxqueued = g_mapsched.threadCount() / 2;
+    if (maxqueued < 1)
+        maxqueued = 1;
+
+    prefetchmore = false;
+    for (const Cand& c : missing)
+    {
+        if ((int)prefetched.size() >= prefetchmax || queued >= maxqueued)
+        {
+            prefetchmore = queued >= maxqueued && (int)prefetched.size() < prefetchmax;
+            break;
+        }
+        Quad *q = c.q;
+        if (q)
+        {
+            q->stopped = false;
+        }
+        else
+        {
+            q = new Quad(&l, c.i, c.j);
+            cachedbiomes.push_back(q);
+        }
+        q->speculative = true;
+        prefetched.push_back(q);
+        schedule(q, PREFETCH_PRIO(c.d));
+        queued++;
+    }
+}
+
+// destination of a tile in the view, snapped to whole pixels such that
+// neighbouring tiles share their edges without gaps or overlap
+static QRect tileRect(int vw, int vh, qreal focusx, qreal focusz, qreal blocks2pix,
+        qint64 bx, qint64 bz, int blocks)
+{
+    qreal ox = vw/2.0 - focusx * blocks2pix;
+    qreal oz = vh/2.0 - focusz * blocks2pix;
+    int x0 = (int) floor(ox + bx * blocks2pix);
+    int z0 = (int) floor(oz + bz * blocks2pix);
+    int x1 = (int) floor(ox + (bx + blocks) * blocks2pix);
+    int z1 = (int) floor(oz + (bz + blocks) * blocks2pix);
+    return QRect(x0, z0, x1 - x0, z1 - z0);
+}
+
+// screen position of a structure marker, which is moved to the center of
+// the bounding box when it is shown, returns false if it is out of view
+static bool markerPos(int sopt, const VarPos& vp, int vw, int vh,
+        qreal focusx, qreal focusz, qreal blocks2pix, bool bb, QPointF *d, QRect *box)
+{
+    qreal x = vw/2.0 + (vp.p.x - focusx) * blocks2pix;
+    qreal y = vh/2.0 + (vp.p.z - focusz) * blocks2pix;
+
+    if (x < 0 || x >= vw || y < 0 || y >= vh)
+        return false;
+
+    if (box)
+        *box = QRect();
+    if (bb)
+    {
+        int sx = vp.sx, sz = vp.sz;
+        if (sopt == D_DESERT)
+        {
+            sx = 21; sz = 21;
+        }
+        else if (sopt == D_JUNGLE)
+        {
+            sx = 12; sz = 15;
+        }
+        else if (sopt == D_HUT)
+        {
+            sx = 7; sz = 9;
+        }
+        else if (sopt == D_MONUMENT)
+        {
+            x -= 29 * blocks2pix;
+            y -= 29 * blocks2pix;
+            sx = 58; sz = 58;
+        }
+
+        if (sx && sz)
+        {   // bounding box with the icon at its center
+            qreal dx = sx * blocks2pix;
+            qreal dy = sz * blocks2pix;
+            if (box)
+                *box = QRect(x, y, dx, dy);
+            x += dx / 2;
+            y += dy / 2;
+        }
+    }
+
+    *d = QPointF(x, y);
+    return true;
+}
+
 void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz, qreal blocks2pix)
 {
     qreal uiw = vw / blocks2pix;
@@ -610,12 +1159,56 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
     qreal bx1 = focusx + uiw/2;
     qreal bz1 = focusz + uih/2;
 
-    if      (blocks2pix >= qual)     activelv = -1;
-    else if (blocks2pix >= qual/4)   activelv = 0;
-    else if (blocks2pix >= qual/16)  activelv = 1;
-    else if (blocks2pix >= qual/64)  activelv = 2;
-    else if (blocks2pix >= qual/256) activelv = 3;
-    else activelv = lvb.size()-1;
+    activelv = getLevel(blocks2pix);
+
+    qint64 t = g_maptrace.isEnabled() ? g_maptrace.now() : 0;
+
+    // tiles of the base level that are not ready yet are filled in with the
+    // corresponding section of the nearest finished coarser tile
+    int base = activelv+1 < (int)lvb.size() ? activelv+1 : (int)lvb.size()-1;
+    if (base >= 0)
+    {
+        Level& l = lvb[base];
+        std::map<std::tuple<int,int,int>, Quad*> coarse;
+        bool indexed = false;
+
+        for (Quad *q : l.cells)
+        {
+            if (q->img || q->preview)
+                continue;
+            if (!indexed)
+            {   // done quads of the coarser levels by (blocks, ti, tj)
+                for (size_t li = base+1; li < lvb.size(); li++)
+                    for (Quad *c : lvb[li].cells)
+                        if (c->img)
+                            coarse[std::make_tuple(c->blocks, c->ti, c->tj)] = c;
+                for (Quad *c : cachedbiomes)
+                    if (c->img && c->dim == dim && c->blocks > l.blocks)
+                        coarse[std::make_tuple(c->blocks, c->ti, c->tj)] = c;
+                indexed = true;
+            }
+
+            int bx = q->ti * l.blocks, bz = q->tj * l.blocks;
+            for (size_t li = base+1; li < lvb.size(); li++)
+            {
+                int cb = lvb[li].blocks;
+                auto it = coarse.find(std::make_tuple(cb, floordiv(bx, cb), floordiv(bz, cb)));
+                if (it == coarse.end())
+                    continue;
+                Quad *c = it->second;
+                c->lastused = frame;
+                QImage *cimg = c->img;
+                applyColors(cimg, &c->colorver);
+                QRectF src(
+                    (bx - c->ti*cb) / (qreal)c->scale, (bz - c->tj*cb) / (qreal)c->scale,
+                    l.blocks / (qreal)c->scale, l.blocks / (qreal)c->scale);
+                QRect rec = tileRect(vw, vh, focusx, focusz, blocks2pix, bx, bz, l.blocks);
+                painter.drawImage(rec, *cimg, src);
+                break;
+            }
+        }
+    }
+    t = g_maptrace.phase(TR_FILL, t);
 
     for (int li = activelv+1; li >= activelv; --li)
     {
@@ -624,16 +1217,30 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
         Level& l = lvb[li];
         for (Quad *q : l.cells)
         {
-            if (!q->img)
+            QImage *img = q->img; // atomic fetch
+            if (img)
+            {   // q was processed in another thread and is now done
+                applyColors(img, &q->colorver);
+                QImage *pimg = q->preview;
+                if (pimg)
+                {   // the full resolution replaces the preview
+                    q->preview = NULL;
+                    quadmem.fetchAndAddRelaxed(-imageBytes(pimg));
+                    delete pimg;
+                }
+            }
+            else if ((img = q->preview))
+            {
+                applyColors(img, &q->previewver);
+            }
+            else
+            {
                 continue;
-            // q was processed in another thread and is now done
+            }
             qreal ps = q->blocks * blocks2pix;
-            qreal px = vw/2.0 + (q->ti) * ps - focusx * blocks2pix;
-            qreal pz = vh/2.0 + (q->tj) * ps - focusz * blocks2pix;
-            // account for the seam buffer pixels
-            ps += ((SEAM_BUF)*q->blocks / (qreal)q->pixs) * blocks2pix;
-            QRect rec(px,pz,ps,ps);
-            painter.drawImage(rec, *q->img);
+            QRect rec = tileRect(vw, vh, focusx, focusz, blocks2pix,
+                (qint64)q->ti * q->blocks, (qint64)q->tj * q->blocks, q->blocks);
+            painter.drawImage(rec, *img);
 
             if (sshow[D_GRID] && !gridspacing)
             {
@@ -641,6 +1248,7 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
             }
         }
     }
+    t = g_maptrace.phase(TR_BIOMES, t);
 
     if (sshow[D_GRID] && gridspacing)
     {
@@ -665,41 +1273,49 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
 
     if (sshow[D_SLIME] && dim == 0 && blocks2pix*16 > 2.0)
     {
-        long x = floor(bx0 / 16), w = floor(bx1 / 16) - x + 1;
-        long z = floor(bz0 / 16), h = floor(bz1 / 16) - z + 1;
-
-        // conditions when the slime overlay should be updated
-        if (x < slimex || z < slimez ||
-            x+w >= slimex+slimeimg.width() || z+h >= slimez+slimeimg.height() ||
-            w*h*4 >= slimeimg.width()*slimeimg.height())
-        {
-            int pad = 64;
-            x -= pad;
-            z -= pad;
-            w += 2*pad;
-            h += 2*pad;
-            slimeimg = QImage(w, h, QImage::Format_Indexed8);
-            slimeimg.setColor(0, qRgba(0, 0, 0, 64));
-            slimeimg.setColor(1, qRgba(0, 255, 0, 64));
-            slimex = x;
-            slimez = z;
+        int tb = 16 * SLIME_TILE;
+        int ti0 = (int) floor(bx0 / tb), ti1 = (int) floor(bx1 / tb);
+        int tj0 = (int) floor(bz0 / tb), tj1 = (int) floor(bz1 / tb);
+        int ci = (ti0 + ti1) / 2, cj = (tj0 + tj1) / 2;
 
-            for (int j = 0; j < h; j++)
+        for (int tj = tj0; tj <= tj1; tj++)
+        {
+            for (int ti = ti0; ti <= ti1; ti++)
             {
-                for (int i = 0; i < w; i++)
+                qint64 key = ((qint64)ti << 32) | (quint32)tj;
+                SlimeTile *s = slimetiles.value(key);
+                if (!s)
                 {
-                    int isslime = isSlimeChunk(wi.seed, i+x, j+z);
-                    slimeimg.setPixel(i, j, isslime);
+                    s = new SlimeTile(wi.seed, ti, tj);
+                    slimetiles.insert(key, s);
+                    g_mapsched.start(s, SLIME_PRIO(sqdist(ti-ci, tj-cj)), this);
+                    continue;
                 }
+                QImage *img = s->img; // atomic fetch
+                if (!img)
+                    continue;
+                QRect rec = tileRect(vw, vh, focusx, focusz, blocks2pix,
+                    (qint64)ti * tb, (qint64)tj * tb, tb);
+                painter.drawImage(rec, *img);
             }
         }
 
-        qreal ps = 16 * blocks2pix;
-        qreal px = vw/2.0 + slimex * ps - focusx * blocks2pix;
-        qreal pz = vh/2.0 + slimez * ps - focusz * blocks2pix;
-
-        QRect rec(px, pz, ps*slimeimg.width(), ps*slimeimg.height());
-        painter.drawImage(rec, slimeimg);
+        // drop the tiles that are furthest out of view
+        int nview = (ti1 - ti0 + 1) * (tj1 - tj0 + 1);
+        if (slimetiles.size() > 4 * nview + 64)
+        {
+            for (auto it = slimetiles.begin(); it != slimetiles.end(); )
+            {
+                SlimeTile *s = it.value();
+                bool outside = s->ti < ti0 - 1 || s->ti > ti1 + 1 || s->tj < tj0 - 1 || s->tj > tj1 + 1;
+                if (outside && (s->img || g_mapsched.cancel(s)))
+                {
+                    delete s;
+                    it = slimetiles.erase(it);
+                }
+                else ++it;
+            }
+        }
     }
 
 
@@ -722,6 +1338,7 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
             painter.drawLine(QPointF(x,y-r), QPointF(x,y+r));
         }
     }
+    t = g_maptrace.phase(TR_OVERLAYS, t);
 
     for (int sopt = D_DESERT; sopt < D_SPAWN; sopt++)
     {
@@ -729,88 +1346,122 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
         if (!sshow[sopt] || dim != l.dim || activelv > l.viewlv)
             continue;
 
-        std::vector<QPainter::PixmapFragment> frags;
+        bool bb = showBB && blocks2pix > 1.0;
+        int i0, j0, i1, j1;
 
-        for (Quad *q : l.cells)
-        {
-            if (!q->spos)
-                continue;
-            // q was processed in another thread and is now done
-            for (VarPos& vp : *q->spos)
+        if (seldo)
+        {   // check for structure selection near the mouse position
+            QRectF ir = icons[sopt].rect();
+            qreal mx = focusx + (selx - vw/2.0) / blocks2pix;
+            qreal mz = focusz + (selz - vh/2.0) / blocks2pix;
+            qreal rx = ir.width() / blocks2pix, rz = ir.height() / blocks2pix;
+            qreal off = bb ? 58 : 0; // icons can be moved within their bounding box
+            if (l.cellRange(mx-rx-off, mz-rz-off, mx+rx+off+1, mz+rz+off+1, &i0, &j0, &i1, &j1))
             {
-                qreal x = vw/2.0 + (vp.p.x - focusx) * blocks2pix;
-                qreal y = vh/2.0 + (vp.p.z - focusz) * blocks2pix;
-
-                if (x < 0 || x >= vw || y < 0 || y >= vh)
-                    continue;
-
-                if (showBB && blocks2pix > 1.0)
+                for (int j = j0; j <= j1; j++)
                 {
-                    int sx = vp.sx, sz = vp.sz;
-                    if (sopt == D_DESERT)
+                    for (int i = i0; i <= i1; i++)
                     {
-                        sx = 21; sz = 21;
-                    }
-                    else if (sopt == D_JUNGLE)
-                    {
-                        sx = 12; sz = 15;
-                    }
-                    else if (sopt == D_HUT)
-                    {
-                        sx = 7; sz = 9;
-                    }
-                    else if (sopt == D_MONUMENT)
-                    {
-                        x -= 29 * blocks2pix;
-                        y -= 29 * blocks2pix;
-                        sx = 58; sz = 58;
-                    }
-
-                    if (sx && sz)
-                    {   // draw bounding box and move icon to its center
-                        qreal dx = sx * blocks2pix;
-                        qreal dy = sz * blocks2pix;
-                        painter.setPen(QPen(QColor(192, 0, 0, 160), 1));
-                        painter.drawRect(QRect(x, y, dx, dy));
-                        x += dx / 2;
-                        y += dy / 2;
+                        Quad *q = l.cells[j*l.tw + i];
+                        std::vector<VarPos> *spos = q->spos; // atomic fetch
+                        if (!spos)
+                            continue;
+                        for (const VarPos& vp : *spos)
+                        {
+                            QPointF d;
+                            if (!markerPos(sopt, vp, vw, vh, focusx, focusz, blocks2pix, bb, &d, NULL))
+                                continue;
+                            QRectF r = ir;
+                            r.moveCenter(d);
+                            if (r.contains(selx, selz))
+                            {
+                                seltype = sopt;
+                                selpos = vp.p;
+                                selvar = vp.variant;
+                            }
+                        }
                     }
                 }
+            }
+        }
 
-                QPointF d = QPointF(x, y);
-
-                if (seldo)
-                {   // check for structure selection
-                    QRectF r = icons[sopt].rect();
-                    r.moveCenter(d);
-                    if (r.contains(selx, selz))
-                    {
-                        seltype = sopt;
-                        selpos = vp.p;
-                        selvar = vp.variant;
-                    }
+        // identify the finished tiles in view to decide if the markers of
+        // the last frame are still valid
+        bool inview = l.cellRange(bx0, bz0, bx1, bz1, &i0, &j0, &i1, &j1);
+        int ndone = 0;
+        quint64 key = 0;
+        for (int j = j0; inview && j <= j1; j++)
+        {
+            for (int i = i0; i <= i1; i++)
+            {
+                Quad *q = l.cells[j*l.tw + i];
+                if (q->spos)
+                {
+                    ndone++;
+                    key = key * 31 + (quintptr) q;
                 }
-                if (seltype != sopt || selpos.x != vp.p.x || selpos.z != vp.p.z)
-                {   // draw unselected structures
-                    QRectF r = icons[sopt].rect();
-                    if (sopt == D_VILLAGE)
-                    {
-                        if (vp.variant) {
-                            int ix = d.x()-r.width()/2, iy = d.y()-r.height()/2;
-                            painter.drawPixmap(ix, iy, iconzvil);
-                        } else {
-                            frags.push_back(QPainter::PixmapFragment::create(d, r));
-                        }
-                    }
-                    else
+            }
+        }
+
+        MarkerCache& mc = l.markers;
+        int sel = seltype == sopt ? sopt : D_NONE;
+        if (!mc.valid || mc.vw != vw || mc.vh != vh || mc.focusx != focusx ||
+            mc.focusz != focusz || mc.blocks2pix != blocks2pix || mc.bb != bb ||
+            mc.ndone != ndone || mc.key != key || mc.seltype != sel ||
+            (sel != D_NONE && (mc.selpos.x != selpos.x || mc.selpos.z != selpos.z)))
+        {
+            mc.valid = true;
+            mc.vw = vw;
+            mc.vh = vh;
+            mc.focusx = focusx;
+            mc.focusz = focusz;
+            mc.blocks2pix = blocks2pix;
+            mc.bb = bb;
+            mc.ndone = ndone;
+            mc.key = key;
+            mc.seltype = sel;
+            mc.selpos = selpos;
+            mc.frags.clear();
+            mc.zvil.clear();
+            mc.boxes.clear();
+
+            QRectF r = icons[sopt].rect();
+            for (int j = j0; inview && j <= j1; j++)
+            {
+                for (int i = i0; i <= i1; i++)
+                {
+                    Quad *q = l.cells[j*l.tw + i];
+                    std::vector<VarPos> *spos = q->spos; // atomic fetch
+                    if (!spos)
+                        continue;
+                    // q was processed in another thread and is now done
+                    for (const VarPos& vp : *spos)
                     {
-                        frags.push_back(QPainter::PixmapFragment::create(d, r));
+                        QPointF d;
+                        QRect box;
+                        if (!markerPos(sopt, vp, vw, vh, focusx, focusz, blocks2pix, bb, &d, &box))
+                            continue;
+                        if (!box.isNull())
+                            mc.boxes.push_back(box);
+                        if (sel == sopt && selpos.x == vp.p.x && selpos.z == vp.p.z)
+                            continue; // drawn as the selection
+                        if (sopt == D_VILLAGE && vp.variant)
+                            mc.zvil.push_back(QPointF(d.x()-r.width()/2, d.y()-r.height()/2));
+                        else
+                            mc.frags.push_back(QPainter::PixmapFragment::create(d, r));
                     }
                 }
             }
         }
 
-        painter.drawPixmapFragments(frags.data(), frags.size(), icons[sopt]);
+        if (!mc.boxes.empty())
+        {
+            painter.setPen(QPen(QColor(192, 0, 0, 160), 1));
+            painter.drawRects(mc.boxes.data(), mc.boxes.size());
+        }
+        for (const QPointF& p : mc.zvil)
+            painter.drawPixmap((int)p.x(), (int)p.y(), iconzvil);
+        painter.drawPixmapFragments(mc.frags.data(), mc.frags.size(), icons[sopt]);
     }
 
     Pos* sp = spawn; // atomic fetch
@@ -861,12 +1512,20 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
         }
         painter.drawPixmapFragments(frags.data(), frags.size(), icons[D_STRONGHOLD]);
     }
+    t = g_maptrace.phase(TR_STRUCTS, t);
+
+    requeuePreviews();
 
+    frame++;
     for (int sopt = D_DESERT; sopt < D_SPAWN; sopt++)
     {
         Level& l = lvs[sopt];
         if (activelv <= l.viewlv && sshow[sopt] && dim == l.dim)
+        {
             l.update(cachedstruct, bx0, bz0, bx1, bz1);
+            for (Quad *q : l.cells)
+                q->lastused = frame;
+        }
         else if (activelv > l.viewlv+1)
             l.update(cachedstruct, 0, 0, 0, 0);
     }
@@ -874,7 +1533,11 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
     {
         Level& l = lvb[li];
         if (li == activelv || li == activelv+1)
+        {
             l.update(cachedbiomes, bx0, bz0, bx1, bz1);
+            for (Quad *q : l.cells)
+                q->lastused = frame;
+        }
         else
             l.update(cachedbiomes, 0, 0, 0, 0);
     }
@@ -885,7 +1548,7 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
         if (sshow[D_SPAWN] || sshow[D_STRONGHOLD] || (showBB && blocks2pix >= 1.0))
         {
             spawn = (Pos*) -1;
-            QThreadPool::globalInstance()->start(new SpawnStronghold(this, wi));
+            bgpool.start(new SpawnStronghold(this, wi));
         }
     }
 
@@ -932,8 +1595,20 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
         painter.drawPixmap(iconrec.translated(pad,pad), *icon);
     }
 
-    cleancache(cachedbiomes, cachesize);
-    cleancache(cachedstruct, cachesize);
+    cleancache();
+    g_maptrace.phase(TR_UPDATE, t);
+}
+
+void QWorld::getCounters(MapCounters *c)
+{
+    g_mapsched.counts(this, &c->queued, &c->running);
+    c->levels = 0;
+    for (const std::vector<Level>* lv : { &lvb, &lvs })
+        for (const Level& l : *lv)
+            c->levels += l.cells.size();
+    c->cached = cachedbiomes.size() + cachedstruct.size();
+    c->quadmem = quadmem.loadAcquire();
+    c->diskcache = g_tilecache.size();
 }
 
 
@@ -5,9 +5,12 @@
 #include "search.h"
 
 #include <QRunnable>
+#include <QThreadPool>
 #include <QImage>
 #include <QPainter>
 #include <QAtomicPointer>
+#include <QMutex>
+#include <QHash>
 
 #include "cubiomes/finders.h"
 
@@ -126,6 +129,29 @@ inline int mapopt2stype(int opt)
     }
 }
 
+// dimension of a structure option
+inline int mapopt2dim(int opt)
+{
+    if (opt == D_FORTESS || opt == D_BASTION || opt == D_PORTALN)
+        return -1;
+    if (opt == D_ENDCITY || opt == D_GATEWAY)
+        return 1;
+    return 0;
+}
+
+// generator flags of the map tiles: anything that shares their tile cache,
+// or is compared against them, has to generate with the same flags
+inline int mapGenFlags(const WorldInfo& wi)
+{
+    return wi.large | FORCE_OCEAN_VARIANTS;
+}
+
+// width of the biome tiles of the map in cells (at any scale)
+inline int mapTilePixels(int mc)
+{
+    return mc >= MC_1_18 ? 128 : 512;
+}
+
 struct Level;
 
 struct VarPos
@@ -136,8 +162,20 @@ struct VarPos
     int variant;
 };
 
+// tile pixel value for biomes that failed to generate
+#define TILE_NONE 255
+
+// keep the biome IDs, the colors are applied via the color table
+QImage *biomeImage(const int *b, int w, int h);
+
+// g has to be initialized for the dimension of the structure, sne is only
+// needed for end cities and is not modified
 void getStructs(std::vector<VarPos> *out, const StructureConfig sconf,
-        WorldInfo wi, int dim, int x0, int z0, int x1, int z1);
+        WorldInfo wi, Generator *g, SurfaceNoise *sne,
+        int x0, int z0, int x1, int z1);
+
+struct QWorld;
+struct MapCounters;
 
 class Quad : public QRunnable
 {
@@ -147,6 +185,10 @@ public:
 
     void run();
 
+    // memory held by the tile (results and bookkeeping)
+    qint64 memSize() const;
+
+    QWorld *world;
     WorldInfo wi;
     int dim;
     const Generator *g;
@@ -156,22 +198,68 @@ public:
     int pixs;
     int sopt;
 
-    uchar *rgb;
-
     // img and spos act as an atomic gate (with NULL or non-NULL indicating available results)
+    // the biome tile is an 8-bit image of biome IDs, colored via its color table
     QAtomicPointer<QImage> img;
+    // lower resolution biome tile that is available ahead of img
+    QAtomicPointer<QImage> preview;
     QAtomicPointer<std::vector<VarPos>> spos;
 
     std::atomic_bool done; // indicates that no further processing will occur
+    // set by the worker when the preview is done: the quad is not queued and
+    // waits for the controller to queue the full resolution pass
+    std::atomic_bool needfull;
     std::atomic_bool *isdel;
 
 public:
     // externally managed (read/write in controller thread only)
     int prio;
     int stopped; // not done, and also not in processing queue
+    int colorver; // version of the color table applied to img
+    int previewver; // version of the color table applied to preview
+    bool speculative; // prefetched and not yet part of a level
+    qint64 schedprio; // priority in the tile scheduler
+    qint64 lastused; // last frame in which the quad was part of a visible level
+};
+
+// slime chunk overlay for a square of SLIME_TILE chunks
+#define SLIME_TILE 128
+
+class SlimeTile : public QRunnable
+{
+public:
+    SlimeTile(uint64_t seed, int ti, int tj);
+    ~SlimeTile();
+
+    void run();
+
+    uint64_t seed;
+    int ti, tj;
+
+    // one pixel per chunk, available once the tile is done
+    QAtomicPointer<QImage> img;
+};
+
+// structure markers of a level as drawn in the last frame, which are
+// reused for as long as the view and the finished tiles are unchanged
+struct MarkerCache
+{
+    MarkerCache() : valid() {}
+
+    bool valid;
+    int vw, vh;
+    qreal focusx, focusz, blocks2pix;
+    bool bb;
+    int ndone;
+    quint64 key;        // identifies the finished tiles in view
+    int seltype;
+    Pos selpos;
+
+    std::vector<QPainter::PixmapFragment> frags;
+    std::vector<QPointF> zvil;  // zombie villages use a different icon
+    std::vector<QRect> boxes;   // bounding boxes
 };
 
-struct QWorld;
 struct Level
 {
     Level();
@@ -186,6 +274,7 @@ struct Level
     std::vector<Quad*> cells;
     Generator g;
     Layer *entry;
+    QWorld *world;
     WorldInfo wi;
     int dim;
     int tx, tz, tw, th;
@@ -195,6 +284,11 @@ struct Level
     int sopt;
     int viewlv;
     std::atomic_bool *isdel;
+
+    // the cells of a structure level serve as the spatial index of the
+    // markers: this returns the range of cells that overlap an area
+    bool cellRange(qreal x0, qreal z0, qreal x1, qreal z1, int *i0, int *j0, int *i1, int *j1) const;
+    MarkerCache markers;
 };
 
 
@@ -204,45 +298,101 @@ struct QWorld
     ~QWorld();
 
     void clearPool();
+    // are there map tiles or background jobs in progress
+    bool isBusy();
 
     void setDim(int dim);
 
-    void cleancache(std::vector<Quad*>& cache, unsigned int maxsize);
+    // set up the biome levels for the current dimension
+    void initLevels();
+    // free the least recently used cached quads when over the memory budget
+    void cleancache();
+
+    int getLevel(qreal blocks2pix) const;
+
+    // queue a quad in the tile scheduler
+    void schedule(Quad *q, qint64 prio);
+    // queue the full resolution pass of the quads with finished previews
+    void requeuePreviews();
+    void applyColors(QImage *img, int *ver);
 
     void draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz, qreal blocks2pix);
 
+    // tile counts and memory for the render statistics
+    void getCounters(MapCounters *c);
+
+    // speculatively generate the biome tiles for a predicted view
+    void prefetch(int vw, int vh, qreal focusx, qreal focusz, qreal blocks2pix);
+
+    // biome at a position, as far as it is known from the generated tiles,
+    // while the exact biome is looked up in the background (-1 if unknown)
     int getBiome(Pos p);
 
+    // generators for structure tiles, which are cloned as needed such that
+    // each concurrent worker holds its own generator for a dimension
+    Generator *acquireGenerator(int dim);
+    void releaseGenerator(Generator *g);
+
+    // rebuild the tile color table from the current biomeColors
+    void updateBiomeColors();
+
     WorldInfo wi;
     int dim;
     Generator g;
 
+    QMutex genmutex;
+    std::vector<Generator*> genpool[3]; // idle generators by dimension
+    SurfaceNoise sne; // end surface noise, shared by all structure tiles
+
     // the visible area is managed in Quads of different scales (for biomes and structures),
     // which are managed in rectangular sections as levels
     std::vector<Level> lvb;     // levels for biomes
     std::vector<Level> lvs;     // levels for structures
+    std::vector<Level> lvbdim[3]; // biome levels of the inactive dimensions
     int activelv;               // currently visible level
 
     // processed Quads are cached until they are too far out of view
     std::vector<Quad*> cachedbiomes;
     std::vector<Quad*> cachedstruct;
-    unsigned int cachesize;
+    qint64 membudget;           // bytes for all quads (levels and caches)
+    QAtomicInteger<qint64> quadmem; // bytes held by all quads (Quad::memSize)
+    qint64 frame;               // draw counter as the usage time of the quads
+    QAtomicInt nneedfull;       // quads with a pending full resolution pass
+
+    // speculative tiles (part of cachedbiomes) that match the last prediction
+    std::vector<Quad*> prefetched;
+    int prefetchmax;            // budget of speculative tiles (memory)
+    int prefetchkey[5];         // level and tile range of the last prediction
+    bool prefetchmore;          // prediction has tiles that are not queued yet
 
     bool sshow[STRUCT_NUM];
     bool showBB;
     int gridspacing;
 
+    // color table for the biome tiles, applied lazily when drawing
+    QVector<QRgb> biomecolors;
+    int colorver;
+
     // some features such as the world spawn and strongholds will be filled by
     // a designated worker thread once results are done
     QAtomicPointer<Pos> spawn;
     QAtomicPointer<std::vector<Pos>> strongholds;
     QAtomicPointer<QVector<QuadInfo>> qsinfo;
-    // isdel is a flag for the worker thread to stop
+    // isdel is a flag for the tile workers to stop
     std::atomic_bool isdel;
-
-    // slime overlay
-    QImage slimeimg;
-    long slimex, slimez;
+    // the background jobs are kept separate from the map tiles
+    QThreadPool bgpool;
+    std::atomic_bool bgdel;
+
+    // background lookup of the exact biome under the mouse
+    QMutex hovermutex;
+    Pos hoverreq, hoverpos;     // requested and answered positions
+    int hoverreqdim, hoverdim;
+    int hoverid;
+    bool hoverbusy;
+
+    // slime overlay tiles (for the overworld)
+    QHash<qint64, SlimeTile*> slimetiles;
 
     // structure selection from mouse position
     bool seldo;
@@ -11,12 +11,24 @@
 #include <QMenu>
 
 
+void QuadScanThread::run()
+{
+    QVector<QuadInfo> qsinfo;
+    scanQuadStructs(wi.mc, wi.large, wi.seed, &qsinfo, &abort, 0,
+        [this](const QVector<QuadInfo>& res) { emit found(id, res); });
+}
+
+
 QuadListDialog::QuadListDialog(MainWindow *mainwindow)
     : QDialog(mainwindow)
     , ui(new Ui::QuadListDialog)
     , mainwindow(mainwindow)
+    , scan()
+    , scanid()
+    , qhn(),qmn()
 {
     ui->setupUi(this);
+    qRegisterMetaType< QVector<QuadInfo> >("QVector<QuadInfo>");
 
     QFont mono = QFont("Monospace", 9);
     mono.setStyleHint(QFont::TypeWriter);
@@ -43,9 +55,20 @@ QuadListDialog::QuadListDialog(MainWindow *mainwindow)
 
 QuadListDialog::~QuadListDialog()
 {
+    stopScan();
     delete ui;
 }
 
+void QuadListDialog::stopScan()
+{
+    if (!scan)
+        return;
+    scan->abort = true;
+    scan->wait();
+    delete scan;
+    scan = NULL;
+}
+
 
 void QuadListDialog::loadSeed()
 {
@@ -90,6 +113,11 @@ bool QuadListDialog::getSeed(WorldInfo *wi)
 
 void QuadListDialog::refresh()
 {
+    // results of a previous scan that are still underway are ignored
+    stopScan();
+    scanid++;
+    qhn = qmn = 0;
+
     ui->listQuadStruct->setRowCount(0);
     ui->labelMsg->clear();
 
@@ -97,16 +125,22 @@ void QuadListDialog::refresh()
     if (!getSeed(&wi))
         return;
 
-    Generator g;
-    setupGenerator(&g, wi.mc, wi.large);
-    applySeed(&g, 0, wi.seed);
+    ui->labelMsg->setText("正在查找四联结构...");
+    scan = new QuadScanThread(wi, scanid);
+    connect(scan, &QuadScanThread::found, this, &QuadListDialog::onQuadsFound, Qt::QueuedConnection);
+    connect(scan, &QThread::finished, this, &QuadListDialog::onScanFinished, Qt::QueuedConnection);
+    scan->start();
+}
 
-    QVector<QuadInfo> qsinfo;
+void QuadListDialog::onQuadsFound(int id, QVector<QuadInfo> qsinfo)
+{
+    if (id != scanid)
+        return;
 
-    findQuadStructs(Swamp_Hut, &g, &qsinfo);
-    findQuadStructs(Monument, &g, &qsinfo);
+    // keep the rows in place while adding to the table
+    ui->listQuadStruct->setSortingEnabled(false);
 
-    int row = 0, qhn = 0, qmn = 0;
+    int row = ui->listQuadStruct->rowCount();
     for (QuadInfo& qi : qsinfo)
     {
         const char *label;
@@ -155,7 +189,18 @@ void QuadListDialog::refresh()
 
     ui->listQuadStruct->setSortingEnabled(true);
     ui->listQuadStruct->sortByColumn(1, Qt::AscendingOrder);
+}
 
+void QuadListDialog::onScanFinished()
+{
+    // the finished notice of a stopped scan can arrive after a new one started
+    if (!scan || scan->isRunning())
+        return;
+    updateMessage();
+}
+
+void QuadListDialog::updateMessage()
+{
     if (qhn == 0 && qmn == 0)
         ui->labelMsg->setText("这个世界不包含任何四联结构.");
     else if (qhn && qmn)
@@ -2,12 +2,34 @@
 #define QUADLISTDIALOG_H
 
 #include "settings.h"
+#include "search.h"
 
 #include <QDialog>
+#include <QThread>
 
 
 class MainWindow;
 
+Q_DECLARE_METATYPE(QuadInfo)
+
+// scans a world for quad-structures in the background
+struct QuadScanThread : public QThread
+{
+    Q_OBJECT
+public:
+    QuadScanThread(WorldInfo wi, int id) : wi(wi),id(id),abort() {}
+
+    virtual void run() override;
+
+signals:
+    void found(int id, QVector<QuadInfo> qsinfo);
+
+public:
+    WorldInfo wi;
+    int id;
+    std::atomic_bool abort;
+};
+
 namespace Ui {
 class QuadListDialog;
 }
@@ -26,6 +48,9 @@ public:
     bool getSeed(WorldInfo *wi);
 
 private slots:
+    void onQuadsFound(int id, QVector<QuadInfo> qsinfo);
+    void onScanFinished();
+
     void on_buttonGo_clicked();
 
     void on_listQuadStruct_customContextMenuRequested(const QPoint &pos);
@@ -35,8 +60,14 @@ private slots:
     void on_buttonClose_clicked();
 
 private:
+    void stopScan();
+    void updateMessage();
+
     Ui::QuadListDialog *ui;
     MainWindow *mainwindow;
+    QuadScanThread *scan;
+    int scanid;
+    int qhn, qmn;
 };
 
 #endif // QUADLISTDIALOG_H
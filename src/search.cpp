@@ -3,8 +3,17 @@
 #include "mainwindow.h"
 
 #include <QThread>
+#include <QThreadPool>
+#include <QMutex>
 
 #include <algorithm>
+#include <map>
+#include <tuple>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STRUCT_BATCH_AVX2
+#include <immintrin.h>
+#endif
 
 
 static bool intersectLineLine(double ax1, double az1, double ax2, double az2, double bx1, double bz1, double bx2, double bz2)
@@ -44,7 +53,8 @@ static bool isInnerRingOk(int mc, uint64_t seed, int x1, int z1, int x2, int z2,
     StrongholdIter sh;
     Pos p = initFirstStronghold(&sh, mc, seed);
 
-    if (p.x >= x1 && p.x <= x2 && p.z >= z1 && p.z <= z2)
+    // the first stronghold can be up to 112 blocks from its approximate position
+    if (p.x >= x1-112 && p.x <= x2+112 && p.z >= z1-112 && p.z <= z2+112)
         return true;
     // Do a ray cast analysis, checking if any of the generation angles intersect the area.
     double c, s;
@@ -61,6 +71,183 @@ static bool isInnerRingOk(int mc, uint64_t seed, int x1, int z1, int x2, int z2,
 }
 
 
+// The world spawn is searched for grass in a spiral of up to 16 chunks
+// around the estimated spawn position (MC 1.13+).
+#define SPAWN_SEARCH_PAD    (16*16 + 16)
+
+/* Upper bound for the distance (per axis) of the world spawn from the origin,
+ * or -1 if there is no hard limit, i.e. before 1.13 where the spawn performs
+ * a random walk in search for grass.
+ */
+static int getSpawnBound(int mc)
+{
+    if (mc < MC_1_13)
+        return -1;
+    if (mc >= MC_1_18) // climate search: radius 2048, then refined within 512
+        return 2048 + 512 + SPAWN_SEARCH_PAD;
+    return 256 + SPAWN_SEARCH_PAD; // biome search within a radius of 256
+}
+
+
+/* Coarse-to-fine prefilter for biome conditions. The area is sampled at
+ * every 16th and then every 4th cell (e.g. 1:64 and 1:16 spacing for a 1:4
+ * condition) before the full check is needed.
+ *
+ * The samples are a subset of the cells tested by checkForBiomes (same scale,
+ * positions and height), and the biome of a cell does not depend on the rest
+ * of the range. Hence, an excluded biome found here is also found by the full
+ * check, and if all required biomes are found while the filter has no
+ * exclusions, the full check has to pass as well. The absence of a required
+ * biome cannot be concluded from a subset, and such seeds remain undecided.
+ * Since the 'approx' option can only relax the full check, neither result
+ * rejects a seed that the full check (approximate or not) would accept.
+ *
+ * Returns COND_FAILED, COND_OK, or COND_MAYBE_POS_VALID if undecided.
+ * The generator should already be initialized for the seed and dimension.
+ */
+static int prefilterBiomes(Generator *g, const BiomeFilter *bf, Range r,
+        std::atomic_bool *abort)
+{
+    uint64_t req  = bf->riverToFind | bf->oceanToFind;
+    uint64_t reqM = bf->riverToFindM;
+    uint64_t exc  = bf->biomeToExcl;
+    uint64_t excM = bf->biomeToExclM;
+    uint64_t found = 0, foundM = 0;
+
+    for (int stride = 16; stride >= 4; stride /= 4)
+    {
+        // not worth it for areas that are barely larger than the stride
+        if (r.sx < 2*stride || r.sz < 2*stride)
+            continue;
+
+        // the offset stride/2 keeps the sample sets of both stages disjoint
+        for (int j = stride/2; j < r.sz; j += stride)
+        {
+            if (*abort)
+                return COND_FAILED;
+            for (int i = stride/2; i < r.sx; i += stride)
+            {
+                int id = getBiomeAt(g, r.scale, r.x+i, r.y, r.z+j);
+                if (id >= 0 && id < 64)
+                {
+                    if (exc & (1ULL << id))
+                        return COND_FAILED;
+                    found |= (1ULL << id);
+                }
+                else if (id >= 128 && id < 192)
+                {
+                    if (excM & (1ULL << (id-128)))
+                        return COND_FAILED;
+                    foundM |= (1ULL << (id-128));
+                }
+            }
+        }
+
+        if (!exc && !excM && (req & ~found) == 0 && (reqM & ~foundM) == 0)
+            return COND_OK;
+    }
+
+    return COND_MAYBE_POS_VALID;
+}
+
+
+void BiomeMemo::clear()
+{
+    for (int *ids : tiles)
+        free(ids);
+    tiles.clear();
+}
+
+const int *BiomeMemo::getTile(Generator *g, int scale, int y, int tx, int tz)
+{
+    if (g->seed != seed)
+    {
+        clear();
+        seed = g->seed;
+    }
+    // tile coordinates stay well within 21 bits inside the world border
+    int sl = 0;
+    while ((1 << sl) < scale)
+        sl++;
+    quint64 key =
+        ((quint64)(tx & 0x1fffff)) |
+        ((quint64)(tz & 0x1fffff) << 21) |
+        ((quint64)(y & 0x3ff) << 42) |
+        ((quint64)sl << 52) |
+        ((quint64)(g->dim + 1) << 56);
+
+    int *ids = tiles.value(key);
+    if (ids)
+        return ids;
+
+    if (tiles.size() >= MAX_TILES)
+        clear();
+    Range r = {scale, tx * TILE, tz * TILE, TILE, TILE, y, 1};
+    ids = allocCache(g, r);
+    if (genBiomes(g, ids, r))
+    {
+        for (int i = 0; i < TILE*TILE; i++)
+            ids[i] = -1;
+    }
+    tiles.insert(key, ids);
+    return ids;
+}
+
+/* Full coverage version of prefilterBiomes(): with every cell of the range
+ * known the result is decided without an additional check.
+ */
+int BiomeMemo::checkFilter(Generator *g, const BiomeFilter *bf, Range r,
+        std::atomic_bool *abort)
+{
+    uint64_t req  = bf->riverToFind | bf->oceanToFind;
+    uint64_t reqM = bf->riverToFindM;
+    uint64_t exc  = bf->biomeToExcl;
+    uint64_t excM = bf->biomeToExclM;
+    uint64_t found = 0, foundM = 0;
+
+    int tx0 = r.x >= 0 ? r.x / TILE : -1 - (-1 - r.x) / TILE;
+    int tz0 = r.z >= 0 ? r.z / TILE : -1 - (-1 - r.z) / TILE;
+    int tx1 = (r.x + r.sx - 1) >= 0 ? (r.x + r.sx - 1) / TILE : -1 - (-r.x - r.sx) / TILE;
+    int tz1 = (r.z + r.sz - 1) >= 0 ? (r.z + r.sz - 1) / TILE : -1 - (-r.z - r.sz) / TILE;
+
+    for (int tz = tz0; tz <= tz1; tz++)
+    {
+        for (int tx = tx0; tx <= tx1; tx++)
+        {
+            if (*abort)
+                return COND_FAILED;
+            const int *ids = getTile(g, r.scale, r.y, tx, tz);
+            int i0 = std::max(r.x, tx * TILE), i1 = std::min(r.x + r.sx, (tx+1) * TILE);
+            int j0 = std::max(r.z, tz * TILE), j1 = std::min(r.z + r.sz, (tz+1) * TILE);
+            for (int j = j0; j < j1; j++)
+            {
+                const int *row = ids + (j - tz * TILE) * TILE - tx * TILE;
+                for (int i = i0; i < i1; i++)
+                {
+                    int id = row[i];
+                    if (id >= 0 && id < 64)
+                    {
+                        if (exc & (1ULL << id))
+                            return COND_FAILED;
+                        found |= (1ULL << id);
+                    }
+                    else if (id >= 128 && id < 192)
+                    {
+                        if (excM & (1ULL << (id-128)))
+                            return COND_FAILED;
+                        foundM |= (1ULL << (id-128));
+                    }
+                }
+            }
+        }
+    }
+
+    if ((req & ~found) == 0 && (reqM & ~foundM) == 0)
+        return COND_OK;
+    return COND_FAILED;
+}
+
+
 /* Checks if a seeds satisfies the conditions list.
  */
 int testSeedAt(
@@ -574,16 +761,25 @@ L_qm_any:
     case F_SPAWN:
 
         cent->x = cent->z = 0;
-        if (pass != PASS_FULL_64)
-            return COND_MAYBE_POS_INVAL;
 
         x1 = cond->x1 + at.x;
         z1 = cond->z1 + at.z;
         x2 = cond->x2 + at.x;
         z2 = cond->z2 + at.z;
 
+        // the spawn cannot lie outside of a seed independent bound, so such
+        // areas fail already in the 48-bit passes (this does not speed up
+        // the spawn check of the seeds themselves)
+        r = getSpawnBound(gen->mc);
+        if (r > 0 && (x1 > r || x2 < -r || z1 > r || z2 < -r))
+            return COND_FAILED;
+
+        if (pass != PASS_FULL_64)
+            return COND_MAYBE_POS_INVAL;
+
         if (*abort) return COND_FAILED;
         gen->init4Dim(0);
+
         pc = getSpawn(&gen->g);
         if (pc.x >= x1 && pc.x <= x2 && pc.z >= z1 && pc.z <= z2)
         {
@@ -599,7 +795,33 @@ L_qm_any:
         x2 = cond->x2 + at.x;
         z2 = cond->z2 + at.z;
 
-        // TODO: add option for looking for the first stronghold only (which would be faster)
+        if (cond->flags & Condition::FLG_FIRST_ONLY)
+        {
+            // The first stronghold is located within 112 blocks of an
+            // approximate position that depends only on the 48-bit seed.
+            StrongholdIter sh;
+            pc = initFirstStronghold(&sh, gen->mc, gen->seed);
+            if (pc.x < x1-112 || pc.x > x2+112 || pc.z < z1-112 || pc.z > z2+112)
+                return COND_FAILED;
+
+            if (pass != PASS_FULL_64)
+            {
+                cent->x = cent->z = 0;
+                return COND_MAYBE_POS_INVAL;
+            }
+            if (*abort) return COND_FAILED;
+
+            // biome generation for just the one stronghold
+            gen->init4Dim(0);
+            if (nextStronghold(&sh, &gen->g) <= 0)
+                return COND_FAILED;
+            if (sh.pos.x >= x1 && sh.pos.x <= x2 && sh.pos.z >= z1 && sh.pos.z <= z2)
+            {
+                *cent = sh.pos;
+                return COND_OK;
+            }
+            return COND_FAILED;
+        }
 
         rx1 = abs(x1); rx2 = abs(x2);
         rz1 = abs(z1); rz2 = abs(z2);
@@ -797,6 +1019,22 @@ L_noise_biome:
             int h = rz2 - rz1 + 1;
             int y = (s == 0 ? cond->y : cond->y >> 2);
             Range r = {1<<s, rx1, rz1, w, h, y, 1};
+            // neighboring origins of a location scan share the biome tiles,
+            // which decide the exact check ('approx' may relax it instead)
+            if (gen->memo && !cond->approx)
+            {
+                gen->init4Dim(finfo.dim);
+                return gen->memo->checkFilter(&gen->g, &cond->bfilter, r, abort);
+            }
+            // noise based biomes are cheap to sample individually, so try to
+            // decide the condition from a sparse subset of the area first
+            if (gen->mc >= MC_1_18 || finfo.dim != 0)
+            {
+                gen->init4Dim(finfo.dim);
+                valid = prefilterBiomes(&gen->g, &cond->bfilter, r, abort);
+                if (valid != COND_MAYBE_POS_VALID)
+                    return valid;
+            }
             valid = checkForBiomes(&gen->g, NULL, r, finfo.dim, gen->seed,
                 cond->bfilter, cond->approx, (volatile char*)abort) > 0;
         }
@@ -810,7 +1048,287 @@ L_noise_biome:
 }
 
 
-void findQuadStructs(int styp, Generator *g, QVector<QuadInfo> *out)
+// structure placements that can be evaluated in the batched kernel
+enum { PLACE_OTHER, PLACE_FEATURE, PLACE_LARGE };
+
+static int getPlacement(int stype)
+{
+    switch (stype)
+    {
+    case Desert_Pyramid:
+    case Jungle_Temple:
+    case Swamp_Hut:
+    case Igloo:
+    case Village:
+    case Ocean_Ruin:
+    case Shipwreck:
+    case Ruined_Portal:
+    case Ruined_Portal_N:
+        return PLACE_FEATURE;
+    case Monument:
+    case Mansion:
+        return PLACE_LARGE;
+    default:
+        return PLACE_OTHER;
+    }
+}
+
+#ifdef STRUCT_BATCH_AVX2
+
+// Java LCG step on 4 lanes: (s * 0x5deece66d + 0xb) mod 2^48
+// AVX2 lacks a 64-bit multiply, so the product is built from 32-bit parts.
+__attribute__((target("avx2")))
+static inline __m256i nextSeed4(__m256i s)
+{
+    const __m256i kl = _mm256_set1_epi64x(0xdeece66d);
+    const __m256i kh = _mm256_set1_epi64x(0x5);
+    __m256i lo = _mm256_mul_epu32(s, kl);
+    __m256i c1 = _mm256_mul_epu32(_mm256_srli_epi64(s, 32), kl);
+    __m256i c2 = _mm256_mul_epu32(s, kh);
+    __m256i hi = _mm256_slli_epi64(_mm256_add_epi64(c1, c2), 32);
+    s = _mm256_add_epi64(_mm256_add_epi64(lo, hi), _mm256_set1_epi64x(0xb));
+    return _mm256_and_si256(s, _mm256_set1_epi64x(MASK48));
+}
+
+// (int)(s >> 17) % r on 4 lanes, packed into 32-bit integers
+__attribute__((target("avx2")))
+static inline __m128i modInt4(__m256i s, int r)
+{
+    const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    __m256i v = _mm256_srli_epi64(s, 17);
+    __m128i v32 = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(v, idx));
+    // the values are below 2^31, so the quotient is exact in double precision
+    __m256d q = _mm256_div_pd(_mm256_cvtepi32_pd(v32), _mm256_set1_pd(r));
+    __m128i qi = _mm256_cvttpd_epi32(_mm256_floor_pd(q));
+    return _mm_sub_epi32(v32, _mm_mullo_epi32(qi, _mm_set1_epi32(r)));
+}
+
+// Java's nextInt(r) on 4 lanes, including the special case for powers of 2
+__attribute__((target("avx2")))
+static inline __m128i nextInt4(__m256i s, int r)
+{
+    if (r & (r-1))
+        return modInt4(s, r);
+    const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    __m256i v = _mm256_srli_epi64(s, 17);
+    v = _mm256_srli_epi64(_mm256_mul_epu32(v, _mm256_set1_epi64x(r)), 31);
+    return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(v, idx));
+}
+
+__attribute__((target("avx2")))
+static void getStructurePos4(const StructureConfig *sc, int place,
+        const uint64_t *seeds, int regX, int regZ, Pos *out)
+{
+    const uint64_t K = 0x5deece66dULL;
+    uint64_t base = regX*341873128712ULL + regZ*132897987541ULL + sc->salt;
+    int r = sc->chunkRange;
+    __m128i px, pz;
+
+    __m256i s = _mm256_loadu_si256((const __m256i*) seeds);
+    s = _mm256_add_epi64(s, _mm256_set1_epi64x(base));
+    s = _mm256_xor_si256(s, _mm256_set1_epi64x(K));
+
+    if (place == PLACE_LARGE)
+    {   // triangular distribution: average of two attempts per axis
+        s = nextSeed4(s); px = modInt4(s, r);
+        s = nextSeed4(s); px = _mm_add_epi32(px, modInt4(s, r));
+        s = nextSeed4(s); pz = modInt4(s, r);
+        s = nextSeed4(s); pz = _mm_add_epi32(pz, modInt4(s, r));
+        px = _mm_srai_epi32(px, 1);
+        pz = _mm_srai_epi32(pz, 1);
+    }
+    else
+    {
+        s = nextSeed4(s); px = nextInt4(s, r);
+        s = nextSeed4(s); pz = nextInt4(s, r);
+    }
+
+    px = _mm_slli_epi32(_mm_add_epi32(px, _mm_set1_epi32(regX * sc->regionSize)), 4);
+    pz = _mm_slli_epi32(_mm_add_epi32(pz, _mm_set1_epi32(regZ * sc->regionSize)), 4);
+
+    int x[4], z[4];
+    _mm_storeu_si128((__m128i*) x, px);
+    _mm_storeu_si128((__m128i*) z, pz);
+    for (int i = 0; i < 4; i++)
+    {
+        out[i].x = x[i];
+        out[i].z = z[i];
+    }
+}
+
+// Compares the kernel against getStructurePos for a few arbitrary seeds and
+// regions, such that placements that do not match the reference are only
+// ever evaluated with the scalar fallback.
+static bool verifyStructurePos4(int stype, int mc, const StructureConfig *sc, int place)
+{
+    uint64_t x = 0x3b1a7c2d5e6f4081ULL ^ stype;
+    for (int k = 0; k < 8; k++)
+    {
+        uint64_t seeds[4];
+        Pos p[4], q;
+        for (int i = 0; i < 4; i++)
+            seeds[i] = x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        int rx = (int)((x >> 33) % 2001) - 1000;
+        int rz = (int)((x >> 13) % 2001) - 1000;
+        getStructurePos4(sc, place, seeds, rx, rz, p);
+        for (int i = 0; i < 4; i++)
+        {
+            if (!getStructurePos(stype, mc, seeds[i], rx, rz, &q))
+                return false;
+            if (q.x != p[i].x || q.z != p[i].z)
+                return false;
+        }
+    }
+    return true;
+}
+
+#endif // STRUCT_BATCH_AVX2
+
+void getStructurePosBatch(
+    int                         stype,
+    int                         mc,
+    const uint64_t            * seeds,
+    int                         n,
+    int                         regX,
+    int                         regZ,
+    Pos                       * out,
+    char                      * ok
+    )
+{
+    int i = 0;
+
+#ifdef STRUCT_BATCH_AVX2
+    // whether the kernel matches the reference, for each verified structure
+    // configuration, since the version and the salt overrides can change
+    typedef std::tuple<int,int,uint64_t> KernelKey;
+    static QMutex mutex;
+    static std::map<KernelKey, bool> usable;
+    static const bool hasavx2 = __builtin_cpu_supports("avx2");
+
+    int place = getPlacement(stype);
+    StructureConfig sconf;
+    if (hasavx2 && place != PLACE_OTHER && n >= 4 &&
+        getStructureConfig_override(stype, mc, &sconf))
+    {
+        KernelKey key = std::make_tuple(stype, mc, (uint64_t)sconf.salt);
+        bool u;
+        {
+            QMutexLocker locker(&mutex);
+            auto it = usable.find(key);
+            if (it != usable.end())
+                u = it->second;
+            else
+                u = usable[key] = verifyStructurePos4(stype, mc, &sconf, place);
+        }
+        if (u)
+        {
+            for (; i + 4 <= n; i += 4)
+            {
+                getStructurePos4(&sconf, place, seeds+i, regX, regZ, out+i);
+                ok[i+0] = ok[i+1] = ok[i+2] = ok[i+3] = 1;
+            }
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+        ok[i] = getStructurePos(stype, mc, seeds[i], regX, regZ, out+i);
+}
+
+void testStructBlock(
+    Pos                         at,
+    QVector<Condition>        * condvec,
+    int                         mc,
+    const uint64_t            * seeds,
+    int                         n,
+    char                      * valid
+    )
+{
+    memset(valid, 1, n);
+
+    std::vector<Pos> pos;
+    std::vector<char> ok;
+    std::vector<int> cnt;
+
+    for (const Condition& c : *condvec)
+    {
+        const FilterInfo& finfo = g_filterinfo.list[c.type];
+        // conditions after a helper are tested at other origins
+        if (finfo.cat == CAT_HELPER)
+            break;
+        if (c.relative || c.count <= 0)
+            continue;
+        if (finfo.cat != CAT_STRUCT || finfo.stype <= 0)
+            continue;
+        int st = finfo.stype;
+        if (getPlacement(st) == PLACE_OTHER)
+            continue;
+        StructureConfig sconf;
+        if (!getStructureConfig_override(st, mc, &sconf))
+            continue;
+
+        // same area and regions as in testCondAt()
+        int x1 = c.x1 + at.x;
+        int z1 = c.z1 + at.z;
+        int x2 = c.x2 + at.x;
+        int z2 = c.z2 + at.z;
+        int rx1, rz1, rx2, rz2;
+        if (sconf.regionSize == 32)
+        {
+            rx1 = x1 >> 9;
+            rz1 = z1 >> 9;
+            rx2 = x2 >> 9;
+            rz2 = z2 >> 9;
+        }
+        else if (sconf.regionSize == 1)
+        {
+            rx1 = x1 >> 4;
+            rz1 = z1 >> 4;
+            rx2 = x2 >> 4;
+            rz2 = z2 >> 4;
+        }
+        else
+        {
+            rx1 = (x1 / (sconf.regionSize << 4)) - (x1 < 0);
+            rz1 = (z1 / (sconf.regionSize << 4)) - (z1 < 0);
+            rx2 = (x2 / (sconf.regionSize << 4)) - (x2 < 0);
+            rz2 = (z2 / (sconf.regionSize << 4)) - (z2 < 0);
+        }
+
+        pos.resize(n);
+        ok.resize(n);
+        cnt.assign(n, 0);
+
+        for (int rz = rz1; rz <= rz2; rz++)
+        {
+            for (int rx = rx1; rx <= rx2; rx++)
+            {
+                getStructurePosBatch(st, mc, seeds, n, rx, rz, pos.data(), ok.data());
+                for (int i = 0; i < n; i++)
+                {
+                    Pos p = pos[i];
+                    if (ok[i] && p.x >= x1 && p.x <= x2 && p.z >= z1 && p.z <= z2)
+                        cnt[i]++;
+                }
+            }
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (cnt[i] < c.count)
+                valid[i] = 0;
+        }
+    }
+}
+
+
+// world border in regions
+#define QUAD_RADIUS ((int)(3e7 / 512))
+// number of region strips of a parallel scan (per structure type)
+#define QUAD_STRIPS 64
+
+// scans the region rows [rz0, rz1) of the world
+static void findQuadStructsIn(int styp, Generator *g, int rz0, int rz1, QVector<QuadInfo> *out)
 {
     StructureConfig sconf;
     if (!getStructureConfig_override(styp, g->mc, &sconf))
@@ -818,7 +1336,7 @@ void findQuadStructs(int styp, Generator *g, QVector<QuadInfo> *out)
 
     int qmax = 1000;
     Pos *qlist = new Pos[qmax];
-    int r = 3e7 / 512;
+    int r = QUAD_RADIUS;
     int qcnt;
 
     if (styp == Swamp_Hut)
@@ -827,7 +1345,7 @@ void findQuadStructs(int styp, Generator *g, QVector<QuadInfo> *out)
             sconf, 128, g->seed & MASK48,
             low20QuadHutBarely, sizeof(low20QuadHutBarely) / sizeof(uint64_t),
             20, sconf.salt,
-            -r, -r, 2*r, 2*r, qlist, qmax
+            -r, rz0, 2*r, rz1-rz0, qlist, qmax
         );
 
         for (int i = 0; i < qcnt; i++)
@@ -861,7 +1379,7 @@ void findQuadStructs(int styp, Generator *g, QVector<QuadInfo> *out)
             sconf, 160, g->seed & MASK48,
             g_qm_90, sizeof(g_qm_90) / sizeof(uint64_t),
             48, sconf.salt,
-            -r, -r, 2*r, 2*r, qlist, qmax
+            -r, rz0, 2*r, rz1-rz0, qlist, qmax
         );
 
         for (int i = 0; i < qcnt; i++)
@@ -895,6 +1413,111 @@ void findQuadStructs(int styp, Generator *g, QVector<QuadInfo> *out)
     delete[] qlist;
 }
 
+void findQuadStructs(int styp, Generator *g, QVector<QuadInfo> *out)
+{
+    findQuadStructsIn(styp, g, -QUAD_RADIUS, QUAD_RADIUS, out);
+}
+
+// results of completed scans by (seed, mc, large, hut salt, monument salt),
+// where the salts can be overridden by the user
+typedef std::tuple<uint64_t,int,int,uint64_t,uint64_t> QuadScanKey;
+static QMutex g_quadmutex;
+static std::map<QuadScanKey, QVector<QuadInfo>> g_quadcache;
+
+struct QuadStripScan : public QRunnable
+{
+    int mc, large;
+    uint64_t seed;
+    std::atomic_int *next;
+    std::atomic_bool *abort;
+    QMutex *mutex;
+    QVector<QuadInfo> *out;
+    const std::function<void(const QVector<QuadInfo>&)> *found;
+
+    void run()
+    {
+        Generator g;
+        setupGenerator(&g, mc, large);
+        applySeed(&g, 0, seed);
+
+        int i;
+        while (!*abort && (i = (*next)++) < 2*QUAD_STRIPS)
+        {
+            int styp = i < QUAD_STRIPS ? Swamp_Hut : Monument;
+            int k = i % QUAD_STRIPS;
+            int rz0 = -QUAD_RADIUS + (int)((2LL * QUAD_RADIUS * k) / QUAD_STRIPS);
+            int rz1 = -QUAD_RADIUS + (int)((2LL * QUAD_RADIUS * (k+1)) / QUAD_STRIPS);
+
+            QVector<QuadInfo> res;
+            findQuadStructsIn(styp, &g, rz0, rz1, &res);
+            if (res.empty())
+                continue;
+
+            QMutexLocker locker(mutex);
+            *out += res;
+            if (*found)
+                (*found)(res);
+        }
+    }
+};
+
+bool scanQuadStructs(int mc, int large, uint64_t seed, QVector<QuadInfo> *out,
+        std::atomic_bool *abort, int threads,
+        std::function<void(const QVector<QuadInfo>&)> found)
+{
+    StructureConfig hut = {}, mon = {};
+    getStructureConfig_override(Swamp_Hut, mc, &hut);
+    getStructureConfig_override(Monument, mc, &mon);
+    QuadScanKey key = std::make_tuple(seed, mc, large, (uint64_t)hut.salt, (uint64_t)mon.salt);
+    {
+        QMutexLocker locker(&g_quadmutex);
+        auto it = g_quadcache.find(key);
+        if (it != g_quadcache.end())
+        {
+            *out = it->second;
+            if (found && !out->empty())
+                found(*out);
+            return true;
+        }
+    }
+
+    std::atomic_bool noabort(false);
+    if (!abort)
+        abort = &noabort;
+    if (threads <= 0)
+        threads = QThread::idealThreadCount();
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    std::atomic_int next(0);
+    QMutex mutex;
+    QVector<QuadInfo> res;
+    for (int i = 0; i < threads; i++)
+    {
+        QuadStripScan *scan = new QuadStripScan;
+        scan->mc = mc;
+        scan->large = large;
+        scan->seed = seed;
+        scan->next = &next;
+        scan->abort = abort;
+        scan->mutex = &mutex;
+        scan->out = &res;
+        scan->found = &found;
+        pool.start(scan);
+    }
+    pool.waitForDone();
+
+    if (*abort)
+        return false;
+
+    QMutexLocker locker(&g_quadmutex);
+    if (g_quadcache.size() >= 16)
+        g_quadcache.clear();
+    g_quadcache[key] = res;
+    *out = res;
+    return true;
+}
+
 
 
 
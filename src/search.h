@@ -4,7 +4,9 @@
 #include "cubiomes/finders.h"
 
 #include <QVector>
+#include <QHash>
 #include <atomic>
+#include <functional>
 
 #define PRECOMPUTE48_BUFSIZ ((int64_t)1 << 30)
 
@@ -366,7 +368,8 @@ static const struct FilterList
             CAT_STRUCT, 1, 1, 1, 0, 0, 1, 1, MC_1_0, MC_NEWEST, 0, 0, disp++,
             ":icons/stronghold.png",
             "要塞",
-            ""
+            "勾选\"仅第一个要塞\"时只检查内环的第一个要塞（通常离出生点最近）。"
+            "其大致位置仅由种子低48位决定，因此搜索会快得多"
         };
 
         list[F_VILLAGE] = FilterInfo{
@@ -514,9 +517,12 @@ struct Condition
     int count;
     int y;
     int approx;
-    int pad; // unused
+    int flags;
     uint64_t variants;
 
+    enum { // condition flags
+        FLG_FIRST_ONLY   = (1 << 0), // only test the first stronghold
+    };
     enum { // variant flags
         START_PIECE_MASK = (1ULL << 63),
         ABANDONED_MASK   = (1ULL << 62),
@@ -559,6 +565,30 @@ struct StructPos
 };
 
 
+/* Memo of generated biome tiles for repeated checks of overlapping areas,
+ * such as the conditions of neighboring origins in a location scan. The
+ * tiles are dropped when the generator seed changes or the memo is full.
+ * Not thread-safe, each worker should hold its own.
+ */
+struct BiomeMemo
+{
+    enum { TILE = 64, MAX_TILES = 256 };
+
+    BiomeMemo() : tiles(),seed() {}
+    ~BiomeMemo() { clear(); }
+
+    // checks the biome filter against every cell of the range, the generator
+    // should be initialized for the seed and dimension
+    int checkFilter(Generator *g, const BiomeFilter *bf, Range r, std::atomic_bool *abort);
+    void clear();
+
+private:
+    const int *getTile(Generator *g, int scale, int y, int tx, int tz);
+
+    QHash<quint64, int*> tiles;
+    uint64_t seed;
+};
+
 struct WorldGen
 {
     Generator g;
@@ -567,6 +597,7 @@ struct WorldGen
     int mc, large;
     uint64_t seed;
     bool initsurf;
+    BiomeMemo *memo;    // optional biome tile memo for biome conditions
 
     void init(int mc, bool large)
     {
@@ -574,6 +605,7 @@ struct WorldGen
         this->large = large;
         this->seed = 0;
         initsurf = false;
+        memo = NULL;
         setupGenerator(&g, mc, large);
     }
 
@@ -643,6 +675,38 @@ int testCondAt(
     std::atomic_bool          * abort
 );
 
+/* Evaluates the structure attempt positions of the region (regX, regZ) for
+ * 'n' seeds at once, with the same results as getStructurePos (ok[i] is the
+ * return value). Structures with a plain region placement are processed
+ * several seeds wide with AVX2 when available, the rest falls back to
+ * getStructurePos.
+ */
+void getStructurePosBatch(
+    int                         stype,          // structure type
+    int                         mc,             // MC version
+    const uint64_t            * seeds,          // input seeds
+    int                         n,              // number of seeds
+    int                         regX,           // region coordinates
+    int                         regZ,
+    Pos                       * out,            // [out] positions
+    char                      * ok              // [out] attempt exists
+);
+
+/* Runs the PASS_FAST_48 structure checks of a block of seeds at once.
+ * Only conditions that do not depend on a relative position, i.e. those
+ * ahead of any reference point helpers, are considered. On return valid[i]
+ * is zero if seeds[i] fails testSeedAt and non-zero if it remains a
+ * candidate.
+ */
+void testStructBlock(
+    Pos                         at,             // origin for conditions
+    QVector<Condition>        * condvec,        // conditions vector
+    int                         mc,             // MC version
+    const uint64_t            * seeds,          // seeds to check
+    int                         n,              // number of seeds
+    char                      * valid           // [out] candidate flags
+);
+
 struct QuadInfo
 {
     uint64_t c; // constellation seed
@@ -656,5 +720,20 @@ struct QuadInfo
 
 void findQuadStructs(int styp, Generator *g, QVector<QuadInfo> *out);
 
+/* Finds the quad-huts and quad-monuments of a world, scanning strips of
+ * regions in parallel. Results are cached per world, so repeated scans are
+ * immediate. The callback receives the results of each strip as they are
+ * found (from the worker threads, one at a time). Returns false if aborted.
+ */
+bool scanQuadStructs(
+    int                         mc,             // MC version
+    int                         large,          // large biomes
+    uint64_t                    seed,           // world seed
+    QVector<QuadInfo>         * out,            // [out] all results
+    std::atomic_bool          * abort,          // abort flag (may be NULL)
+    int                         threads = 0,    // 0 for the ideal count
+    std::function<void(const QVector<QuadInfo>&)> found = nullptr
+);
+
 
 #endif // SEARCH_H
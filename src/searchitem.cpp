@@ -6,6 +6,11 @@
 #include <QApplication>
 #include <QElapsedTimer>
 
+#include <algorithm>
+
+// number of seeds whose structure conditions are checked together
+#define STRUCT_BLOCK 64
+
 SearchItem::~SearchItem()
 {
     if (searchtype >= 0)
@@ -24,17 +29,64 @@ void SearchItem::run()
     if (searchtype == SEARCH_LIST)
     {   // seed = slist[..]
         uint64_t ie = idx+scnt < len ? idx+scnt : len;
-        for (uint64_t i = idx; i < ie; i++)
+        uint64_t n = ie > idx ? ie - idx : 0;
+        const uint64_t *block = slist + idx;
+        std::vector<char> valid(n);
+        if (n)
+            testStructBlock(origin, pcvec, mc, block, n, valid.data());
+
+        // the entries of the block are grouped by their lower 48 bits through
+        // a permutation, so the list and the matches keep the order of the list
+        std::vector<uint32_t> order(n);
+        for (uint64_t k = 0; k < n; k++)
+            order[k] = k;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return (block[a] & MASK48) < (block[b] & MASK48);
+        });
+        std::vector<char> match(n);
+
+        for (uint64_t g = 0; g < n; )
         {
-            seed = slist[i];
-            gen.setSeed(seed);
-            if (testSeedAt(origin, cpos, pcvec, PASS_FULL_64, &gen, abort)
-                == COND_OK
-            )
+            uint64_t low = block[order[g]] & MASK48;
+            uint64_t ge = g + 1;
+            while (ge < n && (block[order[ge]] & MASK48) == low)
+                ge++;
+
+            if (!valid[order[g]])
+            {   // structure positions only depend on the lower 48 bits
+                g = ge;
+                continue;
+            }
+
+            if (ge - g > 1)
+            {   // check the 48-bit conditions once for the whole group
+                gen.setSeed(low);
+                if (testSeedAt(origin, cpos, pcvec, PASS_FULL_48, &gen, abort)
+                    == COND_FAILED
+                )
+                {
+                    g = ge;
+                    continue;
+                }
+            }
+
+            for (; g < ge; g++)
             {
-                matches.push_back(seed);
+                gen.setSeed(block[order[g]]);
+                if (testSeedAt(origin, cpos, pcvec, PASS_FULL_64, &gen, abort)
+                    == COND_OK
+                )
+                {
+                    match[order[g]] = 1;
+                }
             }
         }
+
+        for (uint64_t k = 0; k < n; k++)
+            if (match[k])
+                matches.push_back(block[k]);
+        if (n)
+            seed = block[n-1];
         isdone = (ie == len);
     }
 
@@ -44,49 +96,88 @@ void SearchItem::run()
         {   // seed = (high << 48) | slist[..]
             uint64_t high = (sstart >> 48) & 0xffff;
             uint64_t lowidx = idx;
+            uint64_t seeds[STRUCT_BLOCK];
+            char valid[STRUCT_BLOCK];
+            bool end = false;
 
-            for (int i = 0; i < scnt; i++)
+            for (int i = 0; i < scnt && !end; )
             {
-                seed = (high << 48) | slist[lowidx];
-
-                gen.setSeed(seed);
-                if (testSeedAt(origin, cpos, pcvec, PASS_FULL_64, &gen, abort)
-                    == COND_OK
-                )
+                int n = 0;
+                uint64_t h = high, l = lowidx;
+                while (n < STRUCT_BLOCK && i + n < scnt && h < 0x10000)
                 {
-                    matches.push_back(seed);
+                    seeds[n++] = (h << 48) | slist[l];
+                    if (++l >= len)
+                    {
+                        l = 0;
+                        h++;
+                    }
                 }
+                testStructBlock(origin, pcvec, mc, seeds, n, valid);
 
-                if (++lowidx >= len)
+                for (int j = 0; j < n; j++, i++)
                 {
-                    lowidx = 0;
-                    if (++high >= 0x10000)
+                    seed = seeds[j];
+
+                    if (valid[j])
                     {
-                        isdone = true;
-                        break;
+                        gen.setSeed(seed);
+                        if (testSeedAt(origin, cpos, pcvec, PASS_FULL_64, &gen, abort)
+                            == COND_OK
+                        )
+                        {
+                            matches.push_back(seed);
+                        }
+                    }
+
+                    if (++lowidx >= len)
+                    {
+                        lowidx = 0;
+                        if (++high >= 0x10000)
+                        {
+                            isdone = end = true;
+                            break;
+                        }
                     }
                 }
             }
         }
         else
         {   // seed++
+            uint64_t seeds[STRUCT_BLOCK];
+            char valid[STRUCT_BLOCK];
+            bool end = false;
+
             seed = sstart;
-            for (int i = 0; i < scnt; i++)
+            for (int i = 0; i < scnt && !end; )
             {
-                gen.setSeed(seed);
-                if (testSeedAt(origin, cpos, pcvec, PASS_FULL_64, &gen, abort)
-                    == COND_OK
-                )
+                int n = scnt - i < STRUCT_BLOCK ? scnt - i : STRUCT_BLOCK;
+                if (~(uint64_t)0 - seed < (uint64_t)(n - 1))
+                    n = ~(uint64_t)0 - seed + 1; // do not wrap around
+                for (int j = 0; j < n; j++)
+                    seeds[j] = seed + j;
+                testStructBlock(origin, pcvec, mc, seeds, n, valid);
+
+                for (int j = 0; j < n; j++, i++)
                 {
-                    matches.push_back(seed);
-                }
+                    if (valid[j])
+                    {
+                        gen.setSeed(seed);
+                        if (testSeedAt(origin, cpos, pcvec, PASS_FULL_64, &gen, abort)
+                            == COND_OK
+                        )
+                        {
+                            matches.push_back(seed);
+                        }
+                    }
 
-                if (seed == ~(uint64_t)0)
-                {
-                    isdone = true;
-                    break;
+                    if (seed == ~(uint64_t)0)
+                    {
+                        isdone = end = true;
+                        break;
+                    }
+                    seed++;
                 }
-                seed++;
             }
         }
     }
@@ -340,6 +431,8 @@ void SearchItemGenerator::presearch()
 
     if (searchtype == SEARCH_LIST && !slist.empty())
     {
+        // the list stays in its original order, so the results and the
+        // resume position of saved sessions refer to the order of the file
         scnt = slist.size();
         for (idx = 0; idx < scnt; idx++)
             if (slist[idx] == sstart)
@@ -529,20 +622,44 @@ SearchItem *SearchItemGenerator::requestItem()
 
                 timer.start();
 
-                for (; low <= MASK48; low++)
+                uint64_t seeds[4*STRUCT_BLOCK];
+                char valid[4*STRUCT_BLOCK];
+
+                while (low <= MASK48)
                 {
-                    gen.setSeed(low);
-                    if (testSeedAt(origin, cpos, &condvec, PASS_FAST_48, &gen,
-                        abort) != COND_FAILED)
+                    int n = 0;
+                    while (n < 4*STRUCT_BLOCK && low + n <= MASK48)
                     {
+                        seeds[n] = low + n;
+                        n++;
+                    }
+                    testStructBlock(origin, &condvec, mc, seeds, n, valid);
+
+                    int j;
+                    for (j = 0; j < n; j++)
+                    {
+                        if (!valid[j])
+                            continue;
+                        gen.setSeed(seeds[j]);
+                        if (testSeedAt(origin, cpos, &condvec, PASS_FAST_48, &gen,
+                            abort) != COND_FAILED)
+                        {
+                            break;
+                        }
+                    }
+                    if (j < n)
+                    {
+                        low += j;
                         break;
                     }
 
                     if (timer.elapsed() > 500)
-                    {
+                    {   // resume after the last rejected seed
+                        low += n - 1;
                         high = 0xffff;
                         break;
                     }
+                    low += n;
                 }
                 if (low > MASK48)
                     isdone = true;
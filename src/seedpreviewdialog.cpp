@@ -0,0 +1,233 @@
+#include "seedpreviewdialog.h"
+#include "ui_seedpreviewdialog.h"
+
+#include "mainwindow.h"
+#include "mapview.h"
+#include "cutil.h"
+#include "tilescheduler.h"
+
+#include <QPainter>
+
+
+// preview size in cells of the chosen scale
+#define PREVIEW_PIXS 128
+// minimum spacing in pixels between the structure regions that are drawn
+#define PREVIEW_SPACING 8
+#define PREVIEW_ICON 10
+// the previews are queued behind the map tiles (including the prefetched ones)
+#define PREVIEW_PRIO(i) ((3LL << 32) + (i))
+
+static QImage g_previewicons[STRUCT_NUM];
+
+// previews of the last used settings by seed
+static QHash<quint64, QImage> g_previewcache;
+static QString g_previewkey;
+
+
+PreviewTask::PreviewTask(QObject *receiver, int id, WorldInfo wi, int scale,
+        const bool *show, std::atomic_bool *abort)
+    : receiver(receiver),id(id),wi(wi),scale(scale),abort(abort)
+{
+    setAutoDelete(false);
+    for (int i = 0; i < STRUCT_NUM; i++)
+        this->show[i] = show[i];
+}
+
+void PreviewTask::run()
+{
+    if (*abort)
+        return;
+
+    // same biomes as the map tiles
+    Generator g;
+    setupGenerator(&g, wi.mc, mapGenFlags(wi));
+    applySeed(&g, 0, wi.seed);
+
+    int half = PREVIEW_PIXS / 2;
+    Range r = {scale, -half, -half, PREVIEW_PIXS, PREVIEW_PIXS, wi.y >> 2, 1};
+    int *ids = allocCache(&g, r);
+    if (genBiomes(&g, ids, r))
+    {
+        for (int i = 0; i < PREVIEW_PIXS*PREVIEW_PIXS; i++)
+            ids[i] = -1;
+    }
+    QImage *bimg = biomeImage(ids, PREVIEW_PIXS, PREVIEW_PIXS);
+    free(ids);
+
+    QVector<QRgb> colors(256);
+    for (int i = 0; i < 256; i++)
+        colors[i] = qRgb(biomeColors[i][0], biomeColors[i][1], biomeColors[i][2]);
+    colors[TILE_NONE] = qRgb(0, 0, 0);
+    bimg->setColorTable(colors);
+    QImage img = bimg->convertToFormat(QImage::Format_RGB32);
+    delete bimg;
+
+    // overworld structures that are sparse enough to be seen at this scale,
+    // with the game's generator flags as for the structures of the map
+    Generator sg;
+    setupGenerator(&sg, wi.mc, wi.large);
+    applySeed(&sg, 0, wi.seed);
+
+    QPainter painter(&img);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    int b0 = -half * scale, b1 = half * scale;
+    for (int sopt = D_DESERT; sopt <= D_PORTAL && !*abort; sopt++)
+    {
+        if (!show[sopt])
+            continue;
+        StructureConfig sconf;
+        if (!getStructureConfig_override(mapopt2stype(sopt), wi.mc, &sconf))
+            continue;
+        if (sconf.regionSize * 16 / scale < PREVIEW_SPACING)
+            continue;
+        std::vector<VarPos> st;
+        getStructs(&st, sconf, wi, &sg, NULL, b0, b0, b1, b1);
+        for (const VarPos& vp : st)
+        {
+            qreal x = (vp.p.x - b0) / (qreal) scale;
+            qreal z = (vp.p.z - b0) / (qreal) scale;
+            QRectF rec(x - PREVIEW_ICON/2.0, z - PREVIEW_ICON/2.0, PREVIEW_ICON, PREVIEW_ICON);
+            painter.drawImage(rec, g_previewicons[sopt]);
+        }
+    }
+    painter.end();
+
+    if (*abort)
+        return;
+    QMetaObject::invokeMethod(receiver, "onPreviewDone", Qt::QueuedConnection,
+        Q_ARG(int, id), Q_ARG(quint64, wi.seed), Q_ARG(QImage, img));
+}
+
+
+SeedPreviewDialog::SeedPreviewDialog(MainWindow *mainwindow, QVector<uint64_t> seeds)
+    : QDialog(mainwindow)
+    , ui(new Ui::SeedPreviewDialog)
+    , mainwindow(mainwindow)
+    , seeds(seeds)
+    , tasks()
+    , abort()
+    , id()
+    , ndone()
+    , items()
+{
+    ui->setupUi(this);
+    setAttribute(Qt::WA_DeleteOnClose);
+    ui->listPreview->setIconSize(QSize(PREVIEW_PIXS, PREVIEW_PIXS));
+
+    if (g_previewicons[D_DESERT].isNull())
+    {
+        for (int sopt = D_DESERT; sopt <= D_PORTAL; sopt++)
+            g_previewicons[sopt] = QImage(QString(":/icons/") + mapopt2str(sopt) + ".png");
+    }
+
+    QFont mono = QFont("Monospace", 9);
+    mono.setStyleHint(QFont::TypeWriter);
+    ui->listPreview->setFont(mono);
+
+    refresh();
+}
+
+SeedPreviewDialog::~SeedPreviewDialog()
+{
+    stopPreviews();
+    delete ui;
+}
+
+void SeedPreviewDialog::stopPreviews()
+{
+    // cancel and wait only for the previews, not for the map tiles
+    abort = true;
+    g_mapsched.clear(this);
+    g_mapsched.waitForDone(this);
+    for (PreviewTask *t : tasks)
+        delete t;
+    tasks.clear();
+    abort = false;
+}
+
+void SeedPreviewDialog::refresh()
+{
+    stopPreviews();
+    id++;
+    ndone = 0;
+    items.clear();
+    ui->listPreview->clear();
+
+    WorldInfo wi;
+    mainwindow->getSeed(&wi, false);
+    int scale = ui->comboScale->currentIndex() == 0 ? 64 : 256;
+    bool show[STRUCT_NUM];
+    for (int sopt = 0; sopt < STRUCT_NUM; sopt++)
+        show[sopt] = mainwindow->getMapView()->getShow(sopt);
+
+    QString key = QString::asprintf("%d_%d_%d_%d_", wi.mc, wi.large, wi.y, scale);
+    for (int sopt = 0; sopt < STRUCT_NUM; sopt++)
+        key += show[sopt] ? '1' : '0';
+    if (key != g_previewkey)
+    {
+        g_previewcache.clear();
+        g_previewkey = key;
+    }
+
+    QPixmap blank(PREVIEW_PIXS, PREVIEW_PIXS);
+    blank.fill(Qt::black);
+    for (uint64_t seed : seeds)
+    {
+        if (items.contains(seed))
+            continue;
+        QListWidgetItem *item = new QListWidgetItem(ui->listPreview);
+        item->setText(QString::asprintf("%" PRId64, (int64_t)seed));
+        item->setData(Qt::UserRole, QVariant::fromValue(seed));
+        items.insert(seed, item);
+
+        auto it = g_previewcache.find(seed);
+        if (it != g_previewcache.end())
+        {
+            item->setIcon(QIcon(QPixmap::fromImage(*it)));
+            ndone++;
+            continue;
+        }
+        item->setIcon(QIcon(blank));
+        wi.seed = seed;
+        PreviewTask *t = new PreviewTask(this, id, wi, scale, show, &abort);
+        g_mapsched.start(t, PREVIEW_PRIO(tasks.size()), this);
+        tasks.push_back(t);
+    }
+    updateMessage();
+}
+
+void SeedPreviewDialog::updateMessage()
+{
+    ui->labelMsg->setText(QString::asprintf("已完成 %d / %d 个种子预览", ndone, items.size()));
+}
+
+void SeedPreviewDialog::onPreviewDone(int id, quint64 seed, QImage img)
+{
+    if (id != this->id)
+        return; // result of a previous set of previews
+    // the cache is bounded to about 64MB of thumbnails
+    if (g_previewcache.size() >= 1024)
+        g_previewcache.clear();
+    g_previewcache.insert(seed, img);
+
+    QListWidgetItem *item = items.value(seed);
+    if (item)
+        item->setIcon(QIcon(QPixmap::fromImage(img)));
+    ndone++;
+    updateMessage();
+}
+
+void SeedPreviewDialog::on_comboScale_currentIndexChanged(int)
+{
+    refresh();
+}
+
+void SeedPreviewDialog::on_listPreview_itemDoubleClicked(QListWidgetItem *item)
+{
+    emit seedSelected(item->data(Qt::UserRole).toULongLong());
+}
+
+void SeedPreviewDialog::on_buttonClose_clicked()
+{
+    close();
+}
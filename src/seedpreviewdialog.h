@@ -0,0 +1,79 @@
+#ifndef SEEDPREVIEWDIALOG_H
+#define SEEDPREVIEWDIALOG_H
+
+#include "settings.h"
+#include "quad.h"
+
+#include <QDialog>
+#include <QRunnable>
+#include <QListWidgetItem>
+#include <QHash>
+
+#include <atomic>
+#include <vector>
+
+
+class MainWindow;
+
+// renders the coarse biome and structure preview of one seed
+struct PreviewTask : public QRunnable
+{
+    PreviewTask(QObject *receiver, int id, WorldInfo wi, int scale,
+            const bool *show, std::atomic_bool *abort);
+
+    void run();
+
+    QObject *receiver;
+    int id;
+    WorldInfo wi;
+    int scale;
+    bool show[STRUCT_NUM];
+    std::atomic_bool *abort;
+};
+
+namespace Ui {
+class SeedPreviewDialog;
+}
+
+/* Thumbnail grid of the search results.
+ * The previews are rendered at a coarse map scale by the tile scheduler of
+ * the map (behind the tiles of the map view, with the same generator flags)
+ * and kept in a cache by seed, so the results can be triaged at a glance.
+ * The dialog is deleted when it is closed, which stops the rendering.
+ */
+class SeedPreviewDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit SeedPreviewDialog(MainWindow *mainwindow, QVector<uint64_t> seeds);
+    ~SeedPreviewDialog();
+
+    void refresh();
+
+signals:
+    void seedSelected(uint64_t seed);
+
+public slots:
+    void onPreviewDone(int id, quint64 seed, QImage img);
+
+private slots:
+    void on_comboScale_currentIndexChanged(int index);
+    void on_listPreview_itemDoubleClicked(QListWidgetItem *item);
+    void on_buttonClose_clicked();
+
+private:
+    void stopPreviews();
+    void updateMessage();
+
+    Ui::SeedPreviewDialog *ui;
+    MainWindow *mainwindow;
+    QVector<uint64_t> seeds;
+    std::vector<PreviewTask*> tasks; // owned, since the scheduler does not delete them
+    std::atomic_bool abort;
+    int id;         // identifies the current set of previews
+    int ndone;
+    QHash<quint64, QListWidgetItem*> items;
+};
+
+#endif // SEEDPREVIEWDIALOG_H
@@ -59,6 +59,10 @@ struct Config
     int queueSize;
     int maxMatching;
     int gridSpacing;
+    int mapCacheSize; // in MB
+    int prefetchTiles;
+    int mapThreads; // 0 for automatic
+    int mapMemory; // in MB
     QString biomeColorPath;
 
     Config() { reset(); }
@@ -74,6 +78,10 @@ struct Config
         queueSize = QThread::idealThreadCount();
         maxMatching = 65536;
         gridSpacing = 0;
+        mapCacheSize = 512;
+        prefetchTiles = 64;
+        mapThreads = 0;
+        mapMemory = 256;
         biomeColorPath = "";
     }
 };
@@ -0,0 +1,320 @@
+#include "tilecache.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QRunnable>
+#include <QtEndian>
+
+#include <algorithm>
+#include <vector>
+
+#include "cubiomes/util.h"
+
+// file header: magic and format version, followed by the number of IDs
+#define TILE_MAGIC  0x31544243 // "CBT1"
+#define TILE_HEADER 8
+// directory of the current cache layout, other directories are removed
+#define TILE_LAYOUT "v2"
+
+TileCache g_tilecache;
+
+
+struct TileWrite : public QRunnable
+{
+    TileCache *cache;
+    QString rel;
+    QByteArray raw; // empty: only mark the tile as recently used
+
+    TileWrite(TileCache *cache, QString rel, QByteArray raw)
+        : cache(cache),rel(rel),raw(raw) {}
+
+    void run()
+    {
+        if (raw.isEmpty())
+            cache->touch(rel);
+        else
+            cache->write(rel, raw);
+    }
+};
+
+struct TileScan : public QRunnable
+{
+    TileCache *cache;
+
+    TileScan(TileCache *cache) : cache(cache) {}
+
+    void run() { cache->scan(); }
+};
+
+
+TileCache::TileCache()
+    : mutex(),writer(),root(),index(),touched()
+    , total(),maxsize(),stamp(),ready(),scanning()
+{
+    writer.setMaxThreadCount(1);
+    writer.setExpiryTimeout(5000);
+}
+
+TileCache::~TileCache()
+{
+    writer.waitForDone();
+}
+
+void TileCache::setMaxSize(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    maxsize = bytes;
+    if (maxsize > 0 && indexed() && total > maxsize)
+        evict();
+}
+
+void TileCache::flush()
+{
+    writer.waitForDone();
+}
+
+qint64 TileCache::size()
+{
+    QMutexLocker locker(&mutex);
+    return ready ? total : 0;
+}
+
+void TileCache::scan()
+{
+    // runs on the writer thread, the directory is read without the lock
+    {
+        QMutexLocker locker(&mutex);
+        if (ready)
+            return;
+    }
+
+    QString path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QHash<QString, Entry> found;
+    qint64 sum = 0;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if (!path.isEmpty())
+    {
+        path += "/tiles";
+        // recover the usage order of previous sessions from the file times
+        QDir dir(path);
+        QDirIterator it(path, QStringList() << "*.bt", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+        {
+            it.next();
+            QFileInfo finfo = it.fileInfo();
+            QString rel = dir.relativeFilePath(finfo.filePath());
+            if (!rel.startsWith(TILE_LAYOUT "/"))
+            {   // tiles of an older layout, which cannot be identified
+                QFile::remove(finfo.filePath());
+                continue;
+            }
+            Entry e;
+            e.size = finfo.size();
+            e.used = finfo.lastModified().toMSecsSinceEpoch();
+            found.insert(rel, e);
+            sum += e.size;
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    root = path;
+    index.swap(found);
+    total = sum;
+    stamp = now;
+    ready = true;
+    if (total > maxsize)
+        evict();
+}
+
+bool TileCache::indexed()
+{
+    // called with a locked mutex: starts the scan on the first request
+    if (!ready && !scanning)
+    {
+        scanning = true;
+        writer.start(new TileScan(this));
+    }
+    return ready;
+}
+
+QString TileCache::relPath(const TileKey& k) const
+{
+    return QString::asprintf(TILE_LAYOUT "/%s_%x_%" PRId64 "_%d_%d/%d_%d_%d_%d.bt",
+        mc2str(k.mc), k.flags, (int64_t)k.seed, k.dim, k.y,
+        k.scale, k.pixs, k.ti, k.tj);
+}
+
+bool TileCache::load(const TileKey& key, int *ids, int n)
+{
+    QString rel = relPath(key);
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        if (maxsize <= 0 || !indexed() || root.isEmpty())
+            return false;
+        auto it = index.find(rel);
+        if (it == index.end())
+            return false;
+        it->used = ++stamp;
+        path = root + "/" + rel;
+        // the usage order is kept in memory, the file time only carries it
+        // over to the next session, so it is updated once per session
+        if (!touched.contains(rel))
+        {
+            touched.insert(rel);
+            writer.start(new TileWrite(this, rel, QByteArray()));
+        }
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray data = file.readAll();
+    file.close();
+
+    // tiles of a different format or size are replaced by the caller
+    const uchar *h = (const uchar*) data.constData();
+    if (data.size() <= TILE_HEADER ||
+        qFromLittleEndian<quint32>(h) != TILE_MAGIC ||
+        qFromLittleEndian<quint32>(h + 4) != (quint32) n)
+    {
+        discard(rel);
+        return false;
+    }
+
+    QByteArray raw = qUncompress(h + TILE_HEADER, data.size() - TILE_HEADER);
+    if (raw.size() != n)
+    {
+        discard(rel);
+        return false;
+    }
+    const uchar *b = (const uchar*) raw.constData();
+    for (int i = 0; i < n; i++)
+        ids[i] = b[i];
+    return true;
+}
+
+bool TileCache::contains(const TileKey& key)
+{
+    QString rel = relPath(key);
+    QMutexLocker locker(&mutex);
+    if (maxsize <= 0 || !indexed())
+        return false;
+    return index.contains(rel);
+}
+
+void TileCache::store(const TileKey& key, const int *ids, int n)
+{
+    {
+        QMutexLocker locker(&mutex);
+        if (maxsize <= 0)
+            return;
+    }
+
+    QByteArray raw(n, 0);
+    uchar *b = (uchar*) raw.data();
+    for (int i = 0; i < n; i++)
+    {
+        if (ids[i] < 0 || ids[i] > 255)
+            return; // not a valid biome tile
+        b[i] = ids[i];
+    }
+
+    writer.start(new TileWrite(this, relPath(key), raw));
+}
+
+void TileCache::touch(const QString& rel)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        if (root.isEmpty() || !index.contains(rel))
+            return;
+        path = root + "/" + rel;
+    }
+    // keep the file time as the usage order for the next session
+    QFile file(path);
+    if (file.open(QIODevice::ReadWrite))
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+#else
+    (void) rel;
+#endif
+}
+
+void TileCache::write(const QString& rel, const QByteArray& raw)
+{
+    // the writer thread is the one that indexes the cache
+    scan();
+
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        if (root.isEmpty() || maxsize <= 0 || index.contains(rel))
+            return;
+        path = root + "/" + rel;
+    }
+
+    QByteArray data(TILE_HEADER, 0);
+    qToLittleEndian<quint32>(TILE_MAGIC, (uchar*) data.data());
+    qToLittleEndian<quint32>(raw.size(), (uchar*) data.data() + 4);
+    data += qCompress(raw);
+
+    QDir().mkpath(QFileInfo(path).path());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(data);
+    if (!file.commit())
+        return;
+
+    QMutexLocker locker(&mutex);
+    Entry e;
+    e.size = data.size();
+    e.used = ++stamp;
+    index.insert(rel, e);
+    touched.insert(rel);
+    total += e.size;
+    if (total > maxsize)
+        evict();
+}
+
+void TileCache::discard(const QString& rel)
+{
+    QMutexLocker locker(&mutex);
+    auto it = index.find(rel);
+    if (it == index.end())
+        return;
+    QFile::remove(root + "/" + rel);
+    total -= it->size;
+    index.erase(it);
+    touched.remove(rel);
+}
+
+void TileCache::evict()
+{
+    // called with a locked mutex: remove the least recently used tiles
+    // until there is some headroom below the size limit
+    std::vector<std::pair<qint64, QString>> order;
+    order.reserve(index.size());
+    for (auto it = index.begin(); it != index.end(); ++it)
+        order.push_back(std::make_pair(it->used, it.key()));
+    std::sort(order.begin(), order.end());
+
+    qint64 target = maxsize - maxsize / 10;
+    for (const auto& o : order)
+    {
+        if (total <= target)
+            break;
+        QFile::remove(root + "/" + o.second);
+        total -= index.value(o.second).size;
+        index.remove(o.second);
+        touched.remove(o.second);
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+
+#include <inttypes.h>
+
+
+// identifies a biome tile of the map across sessions
+struct TileKey
+{
+    int mc;
+    int flags;      // generator flags (including large biomes)
+    uint64_t seed;
+    int dim;
+    int y;
+    int scale;
+    int pixs;
+    int ti, tj;
+};
+
+/* Persistent cache for generated biome tiles.
+ * Tiles are stored as compressed 8-bit biome ID planes, one file per tile,
+ * in a directory per world. The cache directory is indexed and written by a
+ * background thread, tiles are not found until the index is ready. The total
+ * size on disk is limited by evicting the least recently used tiles. All
+ * functions are thread-safe.
+ */
+class TileCache
+{
+public:
+    TileCache();
+    ~TileCache();
+
+    // maximum size on disk in bytes (0 disables the cache), an enabled
+    // cache starts to index its directory in the background
+    void setMaxSize(qint64 bytes);
+
+    // look up a tile with n biome IDs, returns false if it is not cached
+    bool load(const TileKey& key, int *ids, int n);
+    // is a tile available without having to generate it
+    bool contains(const TileKey& key);
+    // schedule a tile to be written to disk
+    void store(const TileKey& key, const int *ids, int n);
+
+    // wait for the index and any pending writes
+    void flush();
+
+    // current size on disk in bytes
+    qint64 size();
+
+private:
+    struct Entry
+    {
+        qint64 size;
+        qint64 used;
+    };
+
+    void scan();
+    bool indexed();
+    QString relPath(const TileKey& key) const;
+    void touch(const QString& rel);
+    void write(const QString& rel, const QByteArray& data);
+    void discard(const QString& rel);
+    void evict();
+
+    friend struct TileWrite;
+    friend struct TileScan;
+
+    QMutex mutex;
+    QThreadPool writer;
+    QString root;
+    QHash<QString, Entry> index;
+    QSet<QString> touched; // file times updated in this session
+    qint64 total;
+    qint64 maxsize;
+    qint64 stamp;
+    bool ready;
+    bool scanning;
+};
+
+extern TileCache g_tilecache;
+
+#endif // TILECACHE_H
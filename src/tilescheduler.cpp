@@ -0,0 +1,264 @@
+#include "tilescheduler.h"
+
+#include <algorithm>
+
+TileScheduler g_mapsched;
+
+
+// heap order: lowest priority value first, then first come first served
+static bool laterEntry(qint64 pa, quint64 sa, qint64 pb, quint64 sb)
+{
+    return pa > pb || (pa == pb && sa > sb);
+}
+
+TileScheduler::TileScheduler()
+    : mutex(),wakeup(),idle()
+    , heap(),queued(),running(),workers(),retired()
+    , nthreads(),nrunning(),nwaiting(),seq()
+{
+}
+
+TileScheduler::~TileScheduler()
+{
+    QMutexLocker locker(&mutex);
+    queued.clear();
+    heap.clear();
+    stopWorkers();
+}
+
+void TileScheduler::setThreadCount(int n)
+{
+    QMutexLocker locker(&mutex);
+    if (n == nthreads)
+        return;
+    nthreads = n;
+    // the queue is kept and the workers are adjusted while holding the lock,
+    // so that start() always sees a consistent set of workers
+    if (!workers.empty())
+        adjustWorkers();
+    reapWorkers();
+}
+
+int TileScheduler::threadCount()
+{
+    QMutexLocker locker(&mutex);
+    return nthreads > 0 ? nthreads : QThread::idealThreadCount();
+}
+
+void TileScheduler::start(QRunnable *task, qint64 prio, const void *owner)
+{
+    QMutexLocker locker(&mutex);
+    Entry e = { prio, ++seq, task };
+    Queued q = { e.seq, owner };
+    queued.insert(task, q); // invalidates a previous entry of the task
+    heap.push_back(e);
+    std::push_heap(heap.begin(), heap.end(), [](const Entry& a, const Entry& b) {
+        return laterEntry(a.prio, a.seq, b.prio, b.seq);
+    });
+    if (heap.size() > 2 * (size_t)queued.size() + 256)
+        compact();
+    if (workers.empty())
+        adjustWorkers();
+    wakeup.wakeOne();
+}
+
+bool TileScheduler::cancel(QRunnable *task)
+{
+    QMutexLocker locker(&mutex);
+    return queued.remove(task) != 0;
+}
+
+void TileScheduler::clear(const void *owner)
+{
+    QMutexLocker locker(&mutex);
+    if (owner == NULL)
+    {
+        queued.clear();
+        heap.clear();
+    }
+    else
+    {
+        for (auto it = queued.begin(); it != queued.end(); )
+        {
+            if (it->owner == owner)
+                it = queued.erase(it);
+            else
+                ++it;
+        }
+        compact();
+    }
+    idle.wakeAll();
+}
+
+bool TileScheduler::busy(const void *owner, int *nqueued, int *nrunning)
+{
+    // called with a locked mutex
+    if (owner == NULL)
+    {
+        *nqueued = queued.size();
+        *nrunning = this->nrunning;
+    }
+    else
+    {
+        *nqueued = 0;
+        for (const Queued& q : queued)
+            *nqueued += (q.owner == owner);
+        *nrunning = running.value(owner);
+    }
+    return *nqueued > 0 || *nrunning > 0;
+}
+
+void TileScheduler::waitForDone(const void *owner)
+{
+    QMutexLocker locker(&mutex);
+    int nq, nr;
+    while (busy(owner, &nq, &nr))
+    {
+        if (workers.empty())
+            adjustWorkers();
+        nwaiting++;
+        idle.wait(&mutex);
+        nwaiting--;
+    }
+}
+
+int TileScheduler::pending(const void *owner)
+{
+    QMutexLocker locker(&mutex);
+    int nq, nr;
+    busy(owner, &nq, &nr);
+    return nq + nr;
+}
+
+void TileScheduler::counts(const void *owner, int *nqueued, int *nrunning)
+{
+    QMutexLocker locker(&mutex);
+    busy(owner, nqueued, nrunning);
+}
+
+void TileScheduler::work(Worker *self)
+{
+    auto later = [](const Entry& a, const Entry& b) {
+        return laterEntry(a.prio, a.seq, b.prio, b.seq);
+    };
+
+    QMutexLocker locker(&mutex);
+    while (!self->quit)
+    {
+        if (queued.isEmpty())
+        {
+            // heap only holds stale entries at this point
+            heap.clear();
+            wakeup.wait(&mutex);
+            continue;
+        }
+
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Entry e = heap.back();
+        heap.pop_back();
+
+        auto it = queued.find(e.task);
+        if (it == queued.end() || it->seq != e.seq)
+            continue; // cancelled or moved to a different priority
+        const void *owner = it->owner;
+        queued.erase(it);
+
+        nrunning++;
+        running[owner]++;
+        locker.unlock();
+        e.task->run();
+        locker.relock();
+        nrunning--;
+        if (--running[owner] == 0)
+            running.remove(owner);
+
+        // the waiters check for the tasks of their owner
+        if (nwaiting > 0)
+            idle.wakeAll();
+    }
+}
+
+void TileScheduler::adjustWorkers()
+{
+    // called with a locked mutex: start or retire workers to match the
+    // thread count, retired workers exit after their current task
+    int n = nthreads > 0 ? nthreads : QThread::idealThreadCount();
+    if (n < 1)
+        n = 1;
+    while ((int)workers.size() < n)
+    {
+        Worker *w = new Worker();
+        w->sched = this;
+        w->quit = false;
+        w->start(QThread::LowPriority);
+        workers.push_back(w);
+    }
+    if ((int)workers.size() > n)
+    {
+        while ((int)workers.size() > n)
+        {
+            workers.back()->quit = true;
+            retired.push_back(workers.back());
+            workers.pop_back();
+        }
+        wakeup.wakeAll();
+    }
+}
+
+void TileScheduler::reapWorkers()
+{
+    // called with a locked mutex: delete the retired workers that have exited
+    for (auto it = retired.begin(); it != retired.end(); )
+    {
+        Worker *w = *it;
+        if (w->isFinished())
+        {
+            w->wait();
+            delete w;
+            it = retired.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void TileScheduler::stopWorkers()
+{
+    // called with a locked mutex on destruction: join all workers
+    for (Worker *w : workers)
+    {
+        w->quit = true;
+        retired.push_back(w);
+    }
+    workers.clear();
+    std::vector<Worker*> ws;
+    ws.swap(retired);
+    wakeup.wakeAll();
+    mutex.unlock();
+    for (Worker *w : ws)
+    {
+        w->wait();
+        delete w;
+    }
+    mutex.lock();
+    idle.wakeAll();
+}
+
+void TileScheduler::compact()
+{
+    // called with a locked mutex: drop the stale entries
+    std::vector<Entry> valid;
+    valid.reserve(queued.size());
+    for (const Entry& e : heap)
+    {
+        auto it = queued.find(e.task);
+        if (it != queued.end() && it->seq == e.seq)
+            valid.push_back(e);
+    }
+    heap.swap(valid);
+    std::make_heap(heap.begin(), heap.end(), [](const Entry& a, const Entry& b) {
+        return laterEntry(a.prio, a.seq, b.prio, b.seq);
+    });
+}
@@ -0,0 +1,92 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QRunnable>
+#include <QHash>
+
+#include <vector>
+
+
+/* Priority scheduler for the map tiles, with its own worker threads.
+ * Tasks are not deleted by the scheduler. Queued tasks can be moved to a
+ * different priority or cancelled in constant time: the queue entries are
+ * tagged with a sequence number and entries that no longer match the task
+ * are skipped (without being dereferenced) when they come up.
+ * Each task belongs to an owner (such as a world of the map), so that one
+ * owner can cancel and wait for its own tasks without affecting the others.
+ */
+class TileScheduler
+{
+public:
+    TileScheduler();
+    ~TileScheduler();
+
+    // number of worker threads (0 uses the ideal thread count), the workers
+    // are added or retired without waiting for their running tasks
+    void setThreadCount(int n);
+    int threadCount();
+
+    // queue a task of an owner, or move an already queued task to a new
+    // priority (lower values are processed first)
+    void start(QRunnable *task, qint64 prio, const void *owner);
+    // remove a task from the queue, returns false if it was not queued
+    bool cancel(QRunnable *task);
+
+    // the following apply to the tasks of an owner, or all tasks for NULL
+    // remove the tasks from the queue
+    void clear(const void *owner);
+    // block until the tasks are neither queued nor running
+    void waitForDone(const void *owner);
+    // number of tasks that are queued or running
+    int pending(const void *owner);
+    // number of queued and of running tasks
+    void counts(const void *owner, int *nqueued, int *nrunning);
+
+private:
+    struct Entry
+    {
+        qint64 prio;
+        quint64 seq;
+        QRunnable *task;
+    };
+
+    struct Queued
+    {
+        quint64 seq;        // the valid heap entry of the task
+        const void *owner;
+    };
+
+    struct Worker : public QThread
+    {
+        TileScheduler *sched;
+        bool quit; // guarded by the scheduler mutex
+        void run() { sched->work(this); }
+    };
+
+    void work(Worker *self);
+    void adjustWorkers();
+    void reapWorkers();
+    void stopWorkers();
+    void compact();
+    bool busy(const void *owner, int *nqueued, int *nrunning);
+
+    QMutex mutex;
+    QWaitCondition wakeup;
+    QWaitCondition idle;
+    std::vector<Entry> heap;
+    QHash<QRunnable*, Queued> queued;
+    QHash<const void*, int> running; // running tasks by owner
+    std::vector<Worker*> workers;
+    std::vector<Worker*> retired; // finishing their last task
+    int nthreads;
+    int nrunning;
+    int nwaiting;
+    quint64 seq;
+};
+
+extern TileScheduler g_mapsched;
+
+#endif // TILESCHEDULER_H